@@ -0,0 +1,189 @@
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bqueue.h"
+#include "harness.h"
+
+/* Sleep while *uaddr is val, for at most the given time if it is not NULL */
+static void futex_wait(atomic_uint_least32_t *uaddr,
+                       uint32_t val,
+                       const struct timespec *timeout)
+{
+    syscall(SYS_futex, (uint32_t *) uaddr, FUTEX_WAIT_PRIVATE, val, timeout,
+            NULL, 0);
+}
+
+/* Wake up at most n threads sleeping on uaddr */
+static void futex_wake(atomic_uint_least32_t *uaddr, int n)
+{
+    syscall(SYS_futex, (uint32_t *) uaddr, FUTEX_WAKE_PRIVATE, n, NULL, NULL,
+            0);
+}
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+bqueue_t *bq_new()
+{
+    bqueue_t *q = malloc(sizeof(bqueue_t));
+    if (!q)
+        return NULL;
+
+    bq_ele_t *dummy = malloc(sizeof(bq_ele_t));
+    if (!dummy) {
+        free(q);
+        return NULL;
+    }
+    dummy->value = NULL;
+    atomic_init(&dummy->next, NULL);
+
+    q->head = q->tail = dummy;
+    pthread_mutex_init(&q->head_lock, NULL);
+    pthread_mutex_init(&q->tail_lock, NULL);
+    atomic_init(&q->seq, 0);
+    atomic_init(&q->waiters, 0);
+    return q;
+}
+
+/* Free all storage used by queue */
+void bq_free(bqueue_t *q)
+{
+    if (!q)
+        return;
+
+    /* The string of the dummy element has been freed by its remover */
+    bq_ele_t *e = q->head;
+    bq_ele_t *next = atomic_load(&e->next);
+    free(e);
+    for (e = next; e; e = next) {
+        next = atomic_load(&e->next);
+        free(e->value);
+        free(e);
+    }
+
+    pthread_mutex_destroy(&q->head_lock);
+    pthread_mutex_destroy(&q->tail_lock);
+    free(q);
+}
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool bq_insert_tail(bqueue_t *q, char *s)
+{
+    if (!q)
+        return false;
+
+    bq_ele_t *newt = malloc(sizeof(bq_ele_t));
+    if (!newt)
+        return false;
+    newt->value = strdup(s);
+    if (!newt->value) {
+        free(newt);
+        return false;
+    }
+    atomic_init(&newt->next, NULL);
+
+    pthread_mutex_lock(&q->tail_lock);
+    atomic_store(&q->tail->next, newt);
+    q->tail = newt;
+    pthread_mutex_unlock(&q->tail_lock);
+
+    /*
+     * A waiting thread registers itself before reading seq, so either it is
+     * seen here, or it reads the new seq and finds the element.
+     */
+    atomic_fetch_add(&q->seq, 1);
+    if (atomic_load(&q->waiters))
+        futex_wake(&q->seq, 1);
+    return true;
+}
+
+/*
+ * Attempt to remove element from head of queue.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ * If sp is non-NULL and an element is removed, copy the removed string to *sp
+ * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ * The space used by the list element and the string should be freed.
+ */
+bool bq_remove_head(bqueue_t *q, char *sp, size_t bufsize)
+{
+    if (!q)
+        return false;
+
+    pthread_mutex_lock(&q->head_lock);
+    bq_ele_t *oldh = q->head;
+    bq_ele_t *newh = atomic_load(&oldh->next);
+    if (!newh) {
+        pthread_mutex_unlock(&q->head_lock);
+        return false;
+    }
+    /* newh becomes the dummy element, and its string belongs to us */
+    char *value = newh->value;
+    q->head = newh;
+    pthread_mutex_unlock(&q->head_lock);
+
+    if (sp && bufsize) {
+        strncpy(sp, value, bufsize - 1);
+        sp[bufsize - 1] = '\0';
+    }
+    free(value);
+    free(oldh);
+    return true;
+}
+
+bool bq_remove_head_wait(bqueue_t *q, char *sp, size_t bufsize, long timeout)
+{
+    if (!q)
+        return false;
+    if (bq_remove_head(q, sp, bufsize))
+        return true;
+    if (timeout == 0)
+        return false;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    bool ok = false;
+    atomic_fetch_add(&q->waiters, 1);
+    for (;;) {
+        uint32_t seq = atomic_load(&q->seq);
+        if ((ok = bq_remove_head(q, sp, bufsize)))
+            break;
+
+        if (timeout < 0) {
+            futex_wait(&q->seq, seq, NULL);
+            continue;
+        }
+        /* FUTEX_WAIT takes a relative timeout */
+        struct timespec now, left;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left.tv_sec = deadline.tv_sec - now.tv_sec;
+        left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+        if (left.tv_nsec < 0) {
+            left.tv_sec--;
+            left.tv_nsec += 1000000000;
+        }
+        if (left.tv_sec < 0)
+            break;
+        futex_wait(&q->seq, seq, &left);
+    }
+    atomic_fetch_sub(&q->waiters, 1);
+    return ok;
+}
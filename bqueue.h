@@ -0,0 +1,77 @@
+#ifndef LAB0_BQUEUE_H
+#define LAB0_BQUEUE_H
+
+/*
+ * This program implements a blocking queue that any number of threads can
+ * insert into and remove from concurrently.
+ *
+ * It is the two-lock queue of Michael and Scott: a singly-linked list that
+ * always starts with a dummy element, with one lock for the head and another
+ * for the tail, so that inserting threads never contend with removing ones.
+ * A removing thread can wait for an element to arrive instead of polling.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Data structure declarations */
+
+/* Linked list element */
+typedef struct BQELE {
+    /* Pointer to array holding string.  Unused in the dummy element */
+    char *value;
+    /* Written under the tail lock, read under the head lock */
+    _Atomic(struct BQELE *) next;
+} bq_ele_t;
+
+/* Queue structure */
+typedef struct {
+    bq_ele_t *head; /* Dummy element in front of the queue */
+    bq_ele_t *tail;
+    pthread_mutex_t head_lock, tail_lock;
+    /* Bumped by every insertion.  Waiting threads sleep on it with futex */
+    atomic_uint_least32_t seq;
+    atomic_int waiters;
+} bqueue_t;
+
+/* Operations on queue */
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+bqueue_t *bq_new();
+
+/*
+ * Free ALL storage used by queue.
+ * No effect if q is NULL.
+ * Must not be called while other threads are still using the queue.
+ */
+void bq_free(bqueue_t *q);
+
+/*
+ * Attempt to insert element at tail of queue, and wake up a thread waiting
+ * in bq_remove_head_wait if there is one.
+ * Same contract as q_insert_tail, and safe to call from any thread.
+ */
+bool bq_insert_tail(bqueue_t *q, char *s);
+
+/*
+ * Attempt to remove element from head of queue.
+ * Same contract as q_remove_head, and safe to call from any thread.
+ */
+bool bq_remove_head(bqueue_t *q, char *sp, size_t bufsize);
+
+/*
+ * Remove element from head of queue, waiting for one to be inserted if the
+ * queue is empty.
+ * Wait at most timeout milliseconds, or forever if timeout is negative.
+ * Return false if q is NULL or the queue was still empty after the timeout.
+ * Otherwise same contract as q_remove_head.
+ */
+bool bq_remove_head_wait(bqueue_t *q, char *sp, size_t bufsize, long timeout);
+
+#endif /* LAB0_BQUEUE_H */
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -20,6 +21,61 @@
 bool simulation = false;
 static cmd_ptr cmd_list = NULL;
 static param_ptr param_list = NULL;
+
+/*
+ * Commands and parameters are also indexed by name in open-addressing hash
+ * tables, so that looking one up does not walk the alphabetical lists, which
+ * are kept for help output.
+ */
+typedef struct {
+    const char *name;
+    void *ele;
+} name_slot_t;
+
+typedef struct {
+    name_slot_t *slots;
+    size_t size; /* Number of slots: zero or a power of two */
+    size_t count;
+} name_table_t;
+
+#define NAME_TABLE_MIN 64
+
+static name_table_t cmd_table;
+static name_table_t param_table;
+
+/*
+ * Storage reused by parse_args for every command line: the words of the
+ * line, null-terminated, and the array of pointers to them.
+ */
+static char *arg_buf = NULL;
+static size_t arg_buf_size = 0;
+static char **arg_vec = NULL;
+static size_t arg_vec_size = 0;
+
+/*
+ * Body of a repeat block.  Its lines are split into words once, as the block
+ * is read, and the words are copied into storage of their own, since those
+ * from parse_args only last until the next line.
+ */
+typedef struct BLOCK_ELE block_ele, *block_ptr;
+
+typedef struct {
+    int argc;
+    char **argv;     /* NULL for a nested block */
+    size_t size;     /* Bytes allocated for argv and its words */
+    block_ptr block; /* Nested block, or NULL */
+} block_cmd_t;
+
+struct BLOCK_ELE {
+    int count; /* Times to run the body */
+    block_cmd_t *cmds;
+    int ncmds;
+    int cmds_size;
+    block_ptr parent; /* Enclosing block */
+};
+
+/* Innermost block still being read, or NULL */
+static block_ptr block_stack = NULL;
 static bool block_flag = false;
 static bool prompt_flag = true;
 
@@ -33,6 +89,9 @@ static double last_time;
 /*
  * Implement buffered I/O using variant of RIO package from CS:APP
  * Must create stack of buffers to handle I/O with nested source commands.
+ *
+ * Regular files are mapped into memory instead, and lines are handed to the
+ * command parser straight from the mapping.
  */
 
 #define RIO_BUFSIZE 8192
@@ -43,11 +102,17 @@ struct RIO_ELE {
     int cnt;               /* Unread bytes in internal buffer */
     char *bufptr;          /* Next unread byte in internal buffer */
     char buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *map;             /* Contents of mapped file, or NULL */
+    size_t map_size;       /* Length of mapping */
+    size_t map_pos;        /* Offset of next unread byte in mapping */
     rio_ptr prev;          /* Next element in stack */
 };
 
 static rio_ptr buf_stack;
-static char linebuf[RIO_BUFSIZE];
+
+/* Line read from a buffered file, grown to fit the longest line so far */
+static char *linebuf = NULL;
+static size_t linebuf_size = 0;
 
 /* Maximum file descriptor */
 static int fd_max = 0;
@@ -73,7 +138,11 @@ static bool do_option_cmd(int argc, char *argv[]);
 static bool do_source_cmd(int argc, char *argv[]);
 static bool do_log_cmd(int argc, char *argv[]);
 static bool do_time_cmd(int argc, char *argv[]);
+static bool do_bench_cmd(int argc, char *argv[]);
 static bool do_comment_cmd(int argc, char *argv[]);
+static bool do_repeat_cmd(int argc, char *argv[]);
+
+static void block_free(block_ptr b);
 
 static void init_in();
 
@@ -98,7 +167,12 @@ void init_cmd()
             " file           | Read commands from source file");
     add_cmd("log", do_log_cmd, " file           | Copy output to file");
     add_cmd("time", do_time_cmd, " cmd arg ...    | Time command execution");
+    add_cmd("bench", do_bench_cmd,
+            " cmd arg ... n  | Run command n times and show distribution of "
+            "its execution time");
     add_cmd("#", do_comment_cmd, " ...            | Display comment");
+    add_cmd("repeat", do_repeat_cmd,
+            " n {            | Run the commands up to a line with } n times");
     add_param("simulation", (int *) &simulation, "Start/Stop simulation mode",
               NULL);
     add_param("verbose", &verblevel, "Verbosity level", NULL);
@@ -110,6 +184,69 @@ void init_cmd()
     first_time = last_time;
 }
 
+/* FNV-1a hash of a name */
+static size_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char) *name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Slot holding name, or the empty slot where it would go */
+static name_slot_t *name_slot(name_table_t *t, const char *name)
+{
+    size_t mask = t->size - 1;
+    size_t i = name_hash(name) & mask;
+    while (t->slots[i].name && strcmp(t->slots[i].name, name) != 0)
+        i = (i + 1) & mask;
+    return &t->slots[i];
+}
+
+/* Element registered under name, or NULL if there is none */
+static void *name_find(name_table_t *t, const char *name)
+{
+    if (!t->size)
+        return NULL;
+    return name_slot(t, name)->ele;
+}
+
+/* Register ele under name, replacing any element of the same name */
+static void name_insert(name_table_t *t, const char *name, void *ele)
+{
+    /* Keep load factor at most 1/2 */
+    if (2 * (t->count + 1) > t->size) {
+        name_table_t old = *t;
+        t->size = old.size ? 2 * old.size : NAME_TABLE_MIN;
+        t->slots = calloc_or_fail(t->size, sizeof(name_slot_t), "name_insert");
+        t->count = 0;
+        for (size_t i = 0; i < old.size; i++) {
+            if (old.slots[i].name) {
+                *name_slot(t, old.slots[i].name) = old.slots[i];
+                t->count++;
+            }
+        }
+        if (old.size)
+            free_array(old.slots, old.size, sizeof(name_slot_t));
+    }
+
+    name_slot_t *slot = name_slot(t, name);
+    if (!slot->name)
+        t->count++;
+    slot->name = name;
+    slot->ele = ele;
+}
+
+static void name_clear(name_table_t *t)
+{
+    if (t->size)
+        free_array(t->slots, t->size, sizeof(name_slot_t));
+    t->slots = NULL;
+    t->size = t->count = 0;
+}
+
 /* Add a new command */
 void add_cmd(char *name, cmd_function operation, char *documentation)
 {
@@ -126,6 +263,7 @@ void add_cmd(char *name, cmd_function operation, char *documentation)
     ele->documentation = documentation;
     ele->next = next_cmd;
     *last_loc = ele;
+    name_insert(&cmd_table, name, ele);
 }
 
 /* Add a new parameter */
@@ -148,25 +286,38 @@ void add_param(char *name,
     ele->setter = setter;
     ele->next = next_param;
     *last_loc = ele;
+    name_insert(&param_table, name, ele);
 }
 
-/* Parse a string into a command line */
-static char **parse_args(char *line, int *argcp)
+/*
+ * Parse a string into a command line.
+ * The words and the array pointing to them live in storage that is reused
+ * for the next line, so they are only valid until then.
+ */
+static char **parse_args(const char *line, size_t len, int *argcp)
 {
-    /*
-     * Must first determine how many arguments there are.
-     * Replace all white space with null characters
-     */
-    size_t len = strlen(line);
-    /* First copy into buffer with each substring null-terminated */
-    char *buf = malloc_or_fail(len + 1, "parse_args");
-    char *src = line;
-    char *dst = buf;
+    if (len + 1 > arg_buf_size) {
+        if (arg_buf)
+            free_block(arg_buf, arg_buf_size);
+        arg_buf_size = 2 * (len + 1);
+        arg_buf = malloc_or_fail(arg_buf_size, "parse_args");
+    }
+    /* No more words than every other character */
+    if (len / 2 + 1 > arg_vec_size) {
+        if (arg_vec)
+            free_array(arg_vec, arg_vec_size, sizeof(char *));
+        arg_vec_size = 2 * (len / 2 + 1);
+        arg_vec = calloc_or_fail(arg_vec_size, sizeof(char *), "parse_args");
+    }
+
+    /* Copy into buffer with each word null-terminated */
+    const char *end = line + len;
+    char *dst = arg_buf;
     bool skipping = true;
 
-    int c;
     int argc = 0;
-    while ((c = *src++) != '\0') {
+    for (const char *src = line; src < end && *src; src++) {
+        int c = (unsigned char) *src;
         if (isspace(c)) {
             if (!skipping) {
                 /* Hit end of word */
@@ -176,24 +327,16 @@ static char **parse_args(char *line, int *argcp)
         } else {
             if (skipping) {
                 /* Hit start of new word */
-                argc++;
+                arg_vec[argc++] = dst;
                 skipping = false;
             }
             *dst++ = c;
         }
     }
+    *dst = '\0';
 
-    /* Now assemble into array of strings */
-    char **argv = calloc_or_fail(argc, sizeof(char *), "parse_args");
-    src = buf;
-    for (int i = 0; i < argc; i++) {
-        argv[i] = strsave_or_fail(src, "parse_args");
-        src += strlen(argv[i]) + 1;
-    }
-
-    free_block(buf, len + 1);
     *argcp = argc;
-    return argv;
+    return arg_vec;
 }
 
 static void record_error()
@@ -212,10 +355,8 @@ static bool interpret_cmda(int argc, char *argv[])
         return true;
 
     /* Try to find matching command */
-    cmd_ptr next_cmd = cmd_list;
+    cmd_ptr next_cmd = name_find(&cmd_table, argv[0]);
     bool ok = true;
-    while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
-        next_cmd = next_cmd->next;
     if (next_cmd) {
         ok = next_cmd->operation(argc, argv);
         if (!ok)
@@ -229,23 +370,122 @@ static bool interpret_cmda(int argc, char *argv[])
     return ok;
 }
 
-/* Execute a command from a command line */
-static bool interpret_cmd(char *cmdline)
+/* Add a command to the body of a block, making room for it */
+static block_cmd_t *block_append(block_ptr b)
+{
+    if (b->ncmds == b->cmds_size) {
+        int new_size = b->cmds_size ? 2 * b->cmds_size : 8;
+        block_cmd_t *cmds =
+            calloc_or_fail(new_size, sizeof(block_cmd_t), "block_append");
+        if (b->cmds) {
+            memcpy(cmds, b->cmds, b->ncmds * sizeof(block_cmd_t));
+            free_array(b->cmds, b->cmds_size, sizeof(block_cmd_t));
+        }
+        b->cmds = cmds;
+        b->cmds_size = new_size;
+    }
+    return &b->cmds[b->ncmds++];
+}
+
+/* Start reading a block, nested in the one being read if any */
+static void block_open(int count)
+{
+    block_ptr b = calloc_or_fail(1, sizeof(block_ele), "block_open");
+    b->count = count;
+    b->parent = block_stack;
+    if (block_stack)
+        block_append(block_stack)->block = b;
+    block_stack = b;
+}
+
+static void block_free(block_ptr b)
+{
+    for (int i = 0; i < b->ncmds; i++) {
+        block_cmd_t *cmd = &b->cmds[i];
+        if (cmd->block)
+            block_free(cmd->block);
+        else
+            free_block(cmd->argv, cmd->size);
+    }
+    if (b->cmds)
+        free_array(b->cmds, b->cmds_size, sizeof(block_cmd_t));
+    free_block(b, sizeof(block_ele));
+}
+
+/* Run the body of a block count times.  Return false if any command failed */
+static bool block_run(block_ptr b)
+{
+    bool ok = true;
+    for (int n = 0; n < b->count && !quit_flag; n++) {
+        for (int i = 0; i < b->ncmds && !quit_flag; i++) {
+            block_cmd_t *cmd = &b->cmds[i];
+            if (cmd->block)
+                ok = block_run(cmd->block) && ok;
+            else
+                ok = interpret_cmda(cmd->argc, cmd->argv) && ok;
+        }
+    }
+    return ok;
+}
+
+/*
+ * Handle a line read inside a block.  Commands are saved in the block, and
+ * the outermost block runs once its closing } is read.
+ */
+static bool block_read(int argc, char *argv[])
+{
+    if (argc == 0)
+        return true;
+
+    if (argc == 1 && strcmp(argv[0], "}") == 0) {
+        block_ptr b = block_stack;
+        block_stack = b->parent;
+        if (block_stack)
+            return true;
+        bool ok = block_run(b);
+        block_free(b);
+        return ok;
+    }
+
+    if (strcmp(argv[0], "repeat") == 0) {
+        bool ok = do_repeat_cmd(argc, argv);
+        if (!ok)
+            record_error();
+        return ok;
+    }
+
+    /* Copy the argument array and the words after it in one block */
+    size_t size = argc * sizeof(char *);
+    for (int i = 0; i < argc; i++)
+        size += strlen(argv[i]) + 1;
+    block_cmd_t *cmd = block_append(block_stack);
+    cmd->argc = argc;
+    cmd->argv = malloc_or_fail(size, "block_read");
+    cmd->size = size;
+    char *dst = (char *) (cmd->argv + argc);
+    for (int i = 0; i < argc; i++) {
+        size_t len = strlen(argv[i]) + 1;
+        memcpy(dst, argv[i], len);
+        cmd->argv[i] = dst;
+        dst += len;
+    }
+    return true;
+}
+
+/* Execute a command from a command line of len characters */
+static bool interpret_cmd(const char *cmdline, size_t len)
 {
     if (quit_flag)
         return false;
 
 #if RPT >= 6
-    report(6, "Interpreting command '%s'\n", cmdline);
+    report(6, "Interpreting command '%.*s'\n", (int) len, cmdline);
 #endif
     int argc;
-    char **argv = parse_args(cmdline, &argc);
-    bool ok = interpret_cmda(argc, argv);
-    for (int i = 0; i < argc; i++)
-        free_string(argv[i]);
-    free_array(argv, argc, sizeof(char *));
-
-    return ok;
+    char **argv = parse_args(cmdline, len, &argc);
+    if (block_stack)
+        return block_read(argc, argv);
+    return interpret_cmda(argc, argv);
 }
 
 /* Set function to be executed as part of program exit */
@@ -283,11 +523,33 @@ static bool do_quit_cmd(int argc, char *argv[])
 
     while (buf_stack)
         pop_file();
+    if (block_stack) {
+        report(1, "Discarding repeat block without closing }");
+        while (block_stack->parent)
+            block_stack = block_stack->parent;
+        block_free(block_stack);
+        block_stack = NULL;
+    }
+    if (linebuf)
+        free_block(linebuf, linebuf_size);
+    linebuf = NULL;
+    linebuf_size = 0;
 
     for (int i = 0; i < quit_helper_cnt; i++) {
         ok = ok && quit_helpers[i](argc, argv);
     }
 
+    /* argv may point into this storage, so it goes last */
+    name_clear(&cmd_table);
+    name_clear(&param_table);
+    if (arg_buf)
+        free_block(arg_buf, arg_buf_size);
+    if (arg_vec)
+        free_array(arg_vec, arg_vec_size, sizeof(char *));
+    arg_buf = NULL;
+    arg_vec = NULL;
+    arg_buf_size = arg_vec_size = 0;
+
     quit_flag = true;
     return ok;
 }
@@ -361,17 +623,14 @@ static bool do_option_cmd(int argc, char *argv[])
             report(1, "Cannot parse '%s' as integer", argv[i]);
             return false;
         }
-        /* Find parameter in list */
-        param_ptr plist = param_list;
-        while (!found && plist) {
-            if (strcmp(plist->name, name) == 0) {
-                int oldval = *plist->valp;
-                *plist->valp = value;
-                if (plist->setter)
-                    plist->setter(oldval);
-                found = true;
-            } else
-                plist = plist->next;
+        /* Find parameter */
+        param_ptr plist = name_find(&param_table, name);
+        if (plist) {
+            int oldval = *plist->valp;
+            *plist->valp = value;
+            if (plist->setter)
+                plist->setter(oldval);
+            found = true;
         }
         /* Didn't find parameter */
         if (!found) {
@@ -432,6 +691,78 @@ static bool do_time_cmd(int argc, char *argv[])
     return ok;
 }
 
+/*
+ * Run a command repeatedly, timing each run with the monotonic clock.
+ * Output of the command below error level is suppressed while it runs, so
+ * that reporting does not dominate the measurement.
+ */
+static bool do_bench_cmd(int argc, char *argv[])
+{
+    int iterations;
+    if (argc < 3 || !get_int(argv[argc - 1], &iterations) || iterations < 1) {
+        report(1, "%s needs a command and a positive number of iterations",
+               argv[0]);
+        return false;
+    }
+
+    uint64_t *samples = calloc_or_fail(iterations, sizeof(uint64_t), "bench");
+    int saved_verblevel = verblevel;
+    if (verblevel > 1)
+        verblevel = 1;
+
+    bool ok = true;
+    int done;
+    uint64_t start = time_ns();
+    for (done = 0; ok && done < iterations; done++) {
+        uint64_t t0 = time_ns();
+        ok = interpret_cmda(argc - 2, argv + 1);
+        samples[done] = time_ns() - t0;
+    }
+    uint64_t elapsed = time_ns() - start;
+    verblevel = saved_verblevel;
+
+    if (!ok)
+        report(1, "'%s' failed in iteration %d of %d", argv[1], done,
+               iterations);
+
+    uint64_t total = 0;
+    for (int i = 0; i < done; i++)
+        total += samples[i];
+    sort_samples(samples, done);
+    report(1, "%12s %12s %12s %12s %12s %12s %12s", "min", "mean", "p50",
+           "p90", "p99", "max", "ns/op");
+    report(1,
+           "%12" PRIu64 " %12.1f %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+           " %12" PRIu64 " %12.1f",
+           samples[0], (double) total / done,
+           sample_percentile(samples, done, 0.50),
+           sample_percentile(samples, done, 0.90),
+           sample_percentile(samples, done, 0.99), samples[done - 1],
+           (double) elapsed / done);
+
+    free_array(samples, iterations, sizeof(uint64_t));
+    return ok;
+}
+
+/*
+ * Start a block of commands that runs n times once its closing } is read.
+ * The body is split into words only once, so that running a workload many
+ * times is not dominated by reading and parsing its lines.
+ */
+static bool do_repeat_cmd(int argc, char *argv[])
+{
+    int count;
+    bool ok = argc == 3 && get_int(argv[1], &count) && count >= 0 &&
+              strcmp(argv[2], "{") == 0;
+    if (!ok)
+        report(1, "%s needs a non-negative count followed by {", argv[0]);
+
+    /* Skip the body of a bad block rather than run it once */
+    if (ok || strcmp(argv[argc - 1], "{") == 0)
+        block_open(ok ? count : 0);
+    return ok;
+}
+
 /* Create new buffer for named file.
  * Name == NULL for stdin.
  * Return true if successful.
@@ -449,9 +780,24 @@ static bool push_file(char *fname)
     rnew->fd = fd;
     rnew->cnt = 0;
     rnew->bufptr = rnew->buf;
+    rnew->map = NULL;
+    rnew->map_size = 0;
+    rnew->map_pos = 0;
     rnew->prev = buf_stack;
     buf_stack = rnew;
 
+    /* Map regular files.  Fall back to reading them if that fails */
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map =
+            mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+            rnew->map = map;
+            rnew->map_size = (size_t) st.st_size;
+        }
+    }
+
     return true;
 }
 
@@ -461,6 +807,8 @@ static void pop_file()
     if (buf_stack) {
         rio_ptr rsave = buf_stack;
         buf_stack = rsave->prev;
+        if (rsave->map)
+            munmap(rsave->map, rsave->map_size);
         close(rsave->fd);
         free_block(rsave, sizeof(rio_t));
     }
@@ -472,19 +820,46 @@ static void init_in()
     buf_stack = NULL;
 }
 
-/* Read command from input file.
- * When hit EOF, close that file and return NULL
- */
-static char *readline()
+/* Make room for at least size bytes in linebuf, keeping its first len */
+static void linebuf_reserve(size_t size, size_t len)
 {
-    int cnt;
-    char c;
-    char *lptr = linebuf;
+    if (size <= linebuf_size)
+        return;
+    size_t new_size = linebuf_size ? linebuf_size : RIO_BUFSIZE;
+    while (new_size < size)
+        new_size *= 2;
+    char *new_buf = malloc_or_fail(new_size, "readline");
+    if (linebuf) {
+        memcpy(new_buf, linebuf, len);
+        free_block(linebuf, linebuf_size);
+    }
+    linebuf = new_buf;
+    linebuf_size = new_size;
+}
 
-    if (!buf_stack)
+/* Next line of a mapped file, which is always complete */
+static char *readline_mapped(size_t *lenp)
+{
+    char *start = buf_stack->map + buf_stack->map_pos;
+    size_t left = buf_stack->map_size - buf_stack->map_pos;
+    if (!left) {
+        /* Encountered EOF */
+        pop_file();
         return NULL;
+    }
+
+    char *nl = memchr(start, '\n', left);
+    size_t len = nl ? (size_t) (nl - start) + 1 : left;
+    buf_stack->map_pos += len;
+    *lenp = len;
+    return start;
+}
 
-    for (cnt = 0; cnt < RIO_BUFSIZE - 2; cnt++) {
+/* Next line of a file read through the buffer, copied into linebuf */
+static char *readline_buffered(size_t *lenp)
+{
+    size_t len = 0;
+    for (;;) {
         if (buf_stack->cnt <= 0) {
             /* Need to read from input file */
             buf_stack->cnt = read(buf_stack->fd, buf_stack->buf, RIO_BUFSIZE);
@@ -492,52 +867,62 @@ static char *readline()
             if (buf_stack->cnt <= 0) {
                 /* Encountered EOF */
                 pop_file();
-                if (cnt > 0) {
-                    /* Last line of file did not terminate with newline. */
-                    /*  Terminate line & return it */
-                    *lptr++ = '\n';
-                    *lptr++ = '\0';
-                    if (echo) {
-                        report_noreturn(1, prompt);
-                        report_noreturn(1, linebuf);
-                    }
-                    return linebuf;
-                }
-                return NULL;
+                if (len == 0)
+                    return NULL;
+                /* Last line of file did not terminate with newline */
+                break;
             }
         }
 
         /* Have text in buffer */
-        c = *buf_stack->bufptr++;
-        *lptr++ = c;
-        buf_stack->cnt--;
-        if (c == '\n')
+        char *nl = memchr(buf_stack->bufptr, '\n', buf_stack->cnt);
+        size_t n = nl ? (size_t) (nl - buf_stack->bufptr) + 1
+                      : (size_t) buf_stack->cnt;
+        linebuf_reserve(len + n + 1, len);
+        memcpy(linebuf + len, buf_stack->bufptr, n);
+        len += n;
+        buf_stack->bufptr += n;
+        buf_stack->cnt -= n;
+        if (nl)
             break;
     }
+    linebuf[len] = '\0';
+    *lenp = len;
+    return linebuf;
+}
 
-    if (c != '\n') {
-        /* Hit buffer limit.  Artificially terminate line */
-        *lptr++ = '\n';
-    }
-    *lptr++ = '\0';
+/* Read command from input file.
+ * The line has *lenp characters and is not null-terminated.  It is valid
+ * until the next line is read.
+ * When hit EOF, close that file and return NULL
+ */
+static char *readline(size_t *lenp)
+{
+    if (!buf_stack)
+        return NULL;
 
-    if (echo) {
+    char *line =
+        buf_stack->map ? readline_mapped(lenp) : readline_buffered(lenp);
+    if (line && echo) {
         report_noreturn(1, prompt);
-        report_noreturn(1, linebuf);
+        report_noreturn(1, "%.*s", (int) *lenp, line);
+        if (line[*lenp - 1] != '\n')
+            report_noreturn(1, "\n");
     }
 
-    return linebuf;
+    return line;
 }
 
 /* Determine if there is a complete command line in input buffer */
 static bool read_ready()
 {
-    for (int i = 0; buf_stack && i < buf_stack->cnt; i++) {
-        if (buf_stack->bufptr[i] == '\n')
-            return true;
-    }
-
-    return false;
+    if (!buf_stack)
+        return false;
+    /* A mapped file has all its lines at hand, or needs popping at EOF */
+    if (buf_stack->map)
+        return true;
+    return buf_stack->cnt > 0 &&
+           memchr(buf_stack->bufptr, '\n', buf_stack->cnt) != NULL;
 }
 
 static bool cmd_done()
@@ -562,11 +947,13 @@ int cmd_select(int nfds,
                struct timeval *timeout)
 {
     char *cmdline;
+    size_t len;
     int infd;
     fd_set local_readset;
     while (!block_flag && read_ready()) {
-        cmdline = readline();
-        interpret_cmd(cmdline);
+        cmdline = readline(&len);
+        if (cmdline)
+            interpret_cmd(cmdline, len);
         prompt_flag = true;
     }
 
@@ -602,9 +989,9 @@ int cmd_select(int nfds,
         /* Commandline input available */
         FD_CLR(infd, readfds);
         result--;
-        cmdline = readline();
+        cmdline = readline(&len);
         if (cmdline)
-            interpret_cmd(cmdline);
+            interpret_cmd(cmdline, len);
     }
     return result;
 }
@@ -0,0 +1,101 @@
+/*
+ * Stress test for the concurrent queues.
+ *
+ * Runs producers inserting tagged strings and consumers removing them for a
+ * range of thread counts, and checks that every string comes out exactly once
+ * and that no memory is leaked.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "report.h"
+#include "stress.h"
+
+static int nops = 100000; /* Strings inserted by each producer */
+
+/* Run one round with the given thread counts.  Return true if it passed */
+static bool run(stress_queue_t queue, int producers, int consumers)
+{
+    stress_run_t r = {
+        .queue = queue,
+        .producers = producers,
+        .consumers = consumers,
+        .ops = nops,
+        .mix = 100,
+        .latency = false,
+    };
+    bool ok = stress_run(&r);
+    stress_done(&r);
+
+    /* Each string is inserted once and removed once */
+    double rate = r.elapsed > 0 ? 2.0 * producers * nops / r.elapsed : 0;
+    printf("%-8s %9d %9d %14.0f  %s\n", stress_queue_names[queue], producers,
+           consumers, rate, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+static void usage(char *cmd)
+{
+    printf("Usage: %s [-h] [-q QUEUE][-n OPS][-p PRODUCERS][-c CONSUMERS]\n",
+           cmd);
+    printf("\t-h            Print this information\n");
+    printf("\t-q QUEUE      Only test lockfree or blocking queue\n");
+    printf("\t-n OPS        Strings inserted by each producer\n");
+    printf("\t-p PRODUCERS  Largest number of producer threads\n");
+    printf("\t-c CONSUMERS  Largest number of consumer threads\n");
+    exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    int max_producers = 4, max_consumers = 4;
+    int only = -1;
+    int c;
+
+    while ((c = getopt(argc, argv, "hq:n:p:c:")) != -1) {
+        switch (c) {
+        case 'q':
+            for (int i = 0; i < STRESS_NQUEUES; i++) {
+                if (!strcmp(optarg, stress_queue_names[i]))
+                    only = i;
+            }
+            if (only < 0)
+                usage(argv[0]);
+            break;
+        case 'n':
+            nops = atoi(optarg);
+            break;
+        case 'p':
+            max_producers = atoi(optarg);
+            break;
+        case 'c':
+            max_consumers = atoi(optarg);
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            break;
+        }
+    }
+    if (nops < 1 || max_producers < 1 || max_consumers < 1)
+        usage(argv[0]);
+
+    /* Show errors */
+    set_verblevel(1);
+
+    bool ok = true;
+    printf("queue    producers consumers        ops/sec\n");
+    for (int queue = 0; queue < STRESS_NQUEUES; queue++) {
+        if (only >= 0 && queue != only)
+            continue;
+        for (int p = 1; p <= max_producers; p *= 2) {
+            for (int c = 1; c <= max_consumers; c *= 2)
+                ok = run(queue, p, c) && ok;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
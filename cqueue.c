@@ -0,0 +1,281 @@
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cqueue.h"
+#include "harness.h"
+
+/*
+ * A record frees its retired elements once it holds this many more of them
+ * than there can be hazard pointers in total.
+ */
+#define RETIRE_SLACK 64
+
+/*
+ * Get a hazard pointer record for the calling thread, reusing one that no
+ * thread owns if possible.
+ * Return NULL if could not allocate space.
+ */
+static cq_hp_t *hp_acquire(cqueue_t *q)
+{
+    for (cq_hp_t *rec = atomic_load(&q->records); rec; rec = rec->next) {
+        bool idle = false;
+        if (!atomic_load(&rec->active) &&
+            atomic_compare_exchange_strong(&rec->active, &idle, true))
+            return rec;
+    }
+
+    cq_hp_t *rec = malloc(sizeof(cq_hp_t));
+    if (!rec)
+        return NULL;
+    for (int i = 0; i < CQ_HAZARDS; i++)
+        atomic_init(&rec->hazard[i], NULL);
+    atomic_init(&rec->active, true);
+    rec->retired = NULL;
+    rec->nretired = rec->retired_size = 0;
+
+    cq_hp_t *first = atomic_load(&q->records);
+    do {
+        rec->next = first;
+    } while (!atomic_compare_exchange_weak(&q->records, &first, rec));
+    atomic_fetch_add(&q->nrecords, 1);
+    return rec;
+}
+
+/* Give up ownership of a hazard pointer record */
+static void hp_release(cq_hp_t *rec)
+{
+    for (int i = 0; i < CQ_HAZARDS; i++)
+        atomic_store(&rec->hazard[i], NULL);
+    atomic_store(&rec->active, false);
+}
+
+/*
+ * Read the element pointer at src and protect it with hazard pointer i of
+ * rec.  The pointer is read again after publishing the hazard pointer, and
+ * the returned value is one that was still at src once it was protected.
+ */
+static cq_ele_t *hp_protect(cq_hp_t *rec, int i, _Atomic(cq_ele_t *) *src)
+{
+    cq_ele_t *e = atomic_load(src);
+    for (;;) {
+        atomic_store(&rec->hazard[i], e);
+        cq_ele_t *again = atomic_load(src);
+        if (again == e)
+            return e;
+        e = again;
+    }
+}
+
+/* Is element e protected by a hazard pointer of any record? */
+static bool hp_in_use(cqueue_t *q, cq_ele_t *e)
+{
+    for (cq_hp_t *rec = atomic_load(&q->records); rec; rec = rec->next) {
+        for (int i = 0; i < CQ_HAZARDS; i++) {
+            if (atomic_load(&rec->hazard[i]) == e)
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Free the retired elements of rec that no hazard pointer protects */
+static void hp_scan(cqueue_t *q, cq_hp_t *rec)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < rec->nretired; i++) {
+        cq_ele_t *e = rec->retired[i];
+        if (hp_in_use(q, e))
+            rec->retired[kept++] = e;
+        else
+            free(e);
+    }
+    rec->nretired = kept;
+}
+
+/*
+ * Retire element e, which has been removed from the queue, so that it gets
+ * freed once no thread can be accessing it any more.
+ */
+static void hp_retire(cqueue_t *q, cq_hp_t *rec, cq_ele_t *e)
+{
+    size_t limit = RETIRE_SLACK + CQ_HAZARDS * atomic_load(&q->nrecords);
+    while (rec->nretired == rec->retired_size) {
+        size_t size = rec->retired_size ? 2 * rec->retired_size : limit;
+        cq_ele_t **retired = malloc(size * sizeof(cq_ele_t *));
+        if (retired) {
+            if (rec->nretired)
+                memcpy(retired, rec->retired,
+                       rec->nretired * sizeof(cq_ele_t *));
+            free(rec->retired);
+            rec->retired = retired;
+            rec->retired_size = size;
+            break;
+        }
+        /* Cannot grow the list: wait for other threads to let go instead */
+        hp_scan(q, rec);
+        if (rec->nretired == rec->retired_size)
+            sched_yield();
+    }
+
+    rec->retired[rec->nretired++] = e;
+    if (rec->nretired >= limit)
+        hp_scan(q, rec);
+}
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+cqueue_t *cq_new()
+{
+    cqueue_t *q = malloc(sizeof(cqueue_t));
+    if (!q)
+        return NULL;
+
+    cq_ele_t *dummy = malloc(sizeof(cq_ele_t));
+    if (!dummy) {
+        free(q);
+        return NULL;
+    }
+    dummy->value = NULL;
+    atomic_init(&dummy->next, NULL);
+
+    atomic_init(&q->head, dummy);
+    atomic_init(&q->tail, dummy);
+    atomic_init(&q->records, NULL);
+    atomic_init(&q->nrecords, 0);
+    return q;
+}
+
+/* Free all storage used by queue */
+void cq_free(cqueue_t *q)
+{
+    if (!q)
+        return;
+
+    /* The string of the dummy element has been freed by its remover */
+    cq_ele_t *e = atomic_load(&q->head);
+    cq_ele_t *next = atomic_load(&e->next);
+    free(e);
+    for (e = next; e; e = next) {
+        next = atomic_load(&e->next);
+        free(e->value);
+        free(e);
+    }
+
+    cq_hp_t *rec = atomic_load(&q->records);
+    while (rec) {
+        cq_hp_t *rnext = rec->next;
+        for (size_t i = 0; i < rec->nretired; i++)
+            free(rec->retired[i]);
+        free(rec->retired);
+        free(rec);
+        rec = rnext;
+    }
+
+    free(q);
+}
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool cq_insert_tail(cqueue_t *q, char *s)
+{
+    if (!q)
+        return false;
+
+    cq_ele_t *newt = malloc(sizeof(cq_ele_t));
+    if (!newt)
+        return false;
+    newt->value = strdup(s);
+    if (!newt->value) {
+        free(newt);
+        return false;
+    }
+    atomic_init(&newt->next, NULL);
+
+    cq_hp_t *rec = hp_acquire(q);
+    if (!rec) {
+        free(newt->value);
+        free(newt);
+        return false;
+    }
+
+    for (;;) {
+        cq_ele_t *tail = hp_protect(rec, 0, &q->tail);
+        cq_ele_t *next = atomic_load(&tail->next);
+        if (tail != atomic_load(&q->tail))
+            continue;
+        if (next) {
+            /* Tail is lagging behind: help move it forward, then retry */
+            atomic_compare_exchange_strong(&q->tail, &tail, next);
+            continue;
+        }
+        if (atomic_compare_exchange_strong(&tail->next, &next, newt)) {
+            /* Failing is fine: then another thread has moved the tail */
+            atomic_compare_exchange_strong(&q->tail, &tail, newt);
+            break;
+        }
+    }
+
+    hp_release(rec);
+    return true;
+}
+
+/*
+ * Attempt to remove element from head of queue.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ * If sp is non-NULL and an element is removed, copy the removed string to *sp
+ * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ * The space used by the list element and the string should be freed.
+ */
+bool cq_remove_head(cqueue_t *q, char *sp, size_t bufsize)
+{
+    if (!q)
+        return false;
+
+    cq_hp_t *rec = hp_acquire(q);
+    if (!rec)
+        return false;
+
+    cq_ele_t *head, *next;
+    for (;;) {
+        head = hp_protect(rec, 0, &q->head);
+        cq_ele_t *tail = atomic_load(&q->tail);
+        next = hp_protect(rec, 1, &head->next);
+        if (head != atomic_load(&q->head))
+            continue;
+        if (!next) {
+            hp_release(rec);
+            return false;
+        }
+        if (head == tail) {
+            /* Tail is lagging behind: help move it forward, then retry */
+            atomic_compare_exchange_strong(&q->tail, &tail, next);
+            continue;
+        }
+        if (atomic_compare_exchange_strong(&q->head, &head, next))
+            break;
+    }
+
+    /*
+     * next is the new dummy element.  Its string now belongs to this thread,
+     * and the hazard pointer keeps the element alive while it is copied.
+     */
+    if (sp && bufsize) {
+        strncpy(sp, next->value, bufsize - 1);
+        sp[bufsize - 1] = '\0';
+    }
+    free(next->value);
+
+    hp_retire(q, rec, head);
+    hp_release(rec);
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef LAB0_CQUEUE_H
+#define LAB0_CQUEUE_H
+
+/*
+ * This program implements a lock-free queue that any number of threads can
+ * insert into and remove from concurrently.
+ *
+ * It is the non-blocking queue of Michael and Scott: a singly-linked list
+ * that always starts with a dummy element, with head and tail updated by
+ * compare-and-swap.  Removed elements are reclaimed safely with hazard
+ * pointers, so a thread never frees an element another thread may still be
+ * looking at.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Data structure declarations */
+
+/* Linked list element */
+typedef struct CQELE {
+    /* Pointer to array holding string.  Unused in the dummy element */
+    char *value;
+    _Atomic(struct CQELE *) next;
+} cq_ele_t;
+
+/* Number of hazard pointers each thread needs for queue operations */
+#define CQ_HAZARDS 2
+
+/*
+ * Hazard pointer record.  A thread owns a record for the duration of each
+ * queue operation, and publishes in it the elements it is accessing.
+ * Elements it removes are kept on the retired list of the record until no
+ * record points at them any more.
+ */
+typedef struct CQHP {
+    _Atomic(cq_ele_t *) hazard[CQ_HAZARDS];
+    atomic_bool active; /* Is the record owned by a thread? */
+    struct CQHP *next;  /* Records are never unlinked before cq_free */
+    cq_ele_t **retired;
+    size_t nretired, retired_size;
+} cq_hp_t;
+
+/* Queue structure */
+typedef struct {
+    _Atomic(cq_ele_t *) head; /* Dummy element in front of the queue */
+    _Atomic(cq_ele_t *) tail;
+    _Atomic(cq_hp_t *) records;
+    atomic_int nrecords;
+} cqueue_t;
+
+/* Operations on queue */
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+cqueue_t *cq_new();
+
+/*
+ * Free ALL storage used by queue.
+ * No effect if q is NULL.
+ * Must not be called while other threads are still using the queue.
+ */
+void cq_free(cqueue_t *q);
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Same contract as q_insert_tail, and safe to call from any thread.
+ */
+bool cq_insert_tail(cqueue_t *q, char *s);
+
+/*
+ * Attempt to remove element from head of queue.
+ * Same contract as q_remove_head, and safe to call from any thread.
+ */
+bool cq_remove_head(cqueue_t *q, char *sp, size_t bufsize);
+
+#endif /* LAB0_CQUEUE_H */
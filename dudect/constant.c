@@ -1,5 +1,4 @@
 #include "constant.h"
-#include <assert.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -10,19 +9,24 @@
 #include "queue.h"
 #include "random.h"
 
-#define NR_MEASURE 150
 /* Allow random number range from 0 to 65535 */
 const size_t chunk_size = 16;
-/* Number of measurements per test */
-const size_t number_measurements = NR_MEASURE;
+/* Measurements dropped at each end of a batch */
 const int drop_size = 20;
+/*
+ * Queue size set up for the fixed class of inputs.  It is in the middle of
+ * the range of the random class, so that setting up the queue leaves the
+ * caches in a similar state for both classes.
+ */
+#define FIXED_SIZE 5000
 /* Maintain a queue independent from the qtest since
  * we do not want the test to affect the original functionality
  */
 static queue_t *q = NULL;
-static char random_string[NR_MEASURE][8];
-static int random_string_iter = 0;
-enum { test_insert_tail, test_size };
+/* One random string per measurement of the batch */
+static char (*random_string)[8] = NULL;
+static size_t random_string_cnt = 0;
+static size_t random_string_iter = 0;
 
 /* Implement the necessary queue interface to simulation */
 void init_dut(void)
@@ -32,54 +36,154 @@ void init_dut(void)
 
 char *get_random_string(void)
 {
-    random_string_iter = (random_string_iter + 1) % NR_MEASURE;
+    random_string_iter = (random_string_iter + 1) % random_string_cnt;
     return random_string[random_string_iter];
 }
 
-void prepare_inputs(uint8_t *input_data, uint8_t *classes)
+void prepare_inputs(uint8_t *input_data, uint8_t *classes, size_t n)
 {
-    randombytes(input_data, number_measurements * chunk_size);
-    for (size_t i = 0; i < number_measurements; i++) {
-        classes[i] = randombit();
+    if (n != random_string_cnt) {
+        free(random_string);
+        random_string = malloc(n * sizeof(*random_string));
+        if (!random_string)
+            exit(111);
+        random_string_cnt = n;
+        random_string_iter = 0;
+    }
+
+    randombytes(input_data, n * chunk_size);
+    randombits(classes, n);
+    for (size_t i = 0; i < n; i++) {
         if (classes[i] == 0)
-            *(uint16_t *) (input_data + i * chunk_size) = 0x00;
+            *(uint16_t *) (input_data + i * chunk_size) = FIXED_SIZE;
     }
 
-    for (size_t i = 0; i < NR_MEASURE; ++i) {
+    for (size_t i = 0; i < n; ++i) {
         /* Generate random string */
         randombytes((uint8_t *) random_string[i], 7);
         random_string[i][7] = 0;
     }
 }
 
+/* Built-in operations */
+
+/* Argument of the operation being measured */
+static char *dut_string;
+static char dut_buf[8];
+
+/* Queue with as many elements as the input asks for */
+static void setup_queue(uint8_t *input)
+{
+    dut_string = get_random_string();
+    dut_new();
+    dut_insert_head(get_random_string(), *(uint16_t *) input % 10000);
+}
+
+/*
+ * Queues that are never empty, so that removal always takes the same path.
+ * Elements go in at the end they are removed from, so that the element to
+ * remove was touched last, whatever the size of the queue.
+ */
+static void setup_queue_for_head(uint8_t *input)
+{
+    dut_new();
+    dut_insert_head(get_random_string(), 1 + *(uint16_t *) input % 10000);
+}
+
+static void setup_queue_for_tail(uint8_t *input)
+{
+    dut_new();
+    dut_insert_tail(get_random_string(), 1 + *(uint16_t *) input % 10000);
+}
+
+static void teardown_queue(void)
+{
+    dut_free();
+}
+
+static void call_insert_head(void)
+{
+    dut_insert_head(dut_string, 1);
+}
+
+static void call_insert_tail(void)
+{
+    dut_insert_tail(dut_string, 1);
+}
+
+static void call_remove_head(void)
+{
+    q_remove_head(q, dut_buf, sizeof(dut_buf));
+}
+
+static void call_remove_tail(void)
+{
+    q_remove_tail(q, dut_buf, sizeof(dut_buf));
+}
+
+static void call_size(void)
+{
+    dut_size(1);
+}
+
+static const dut_op_t builtin_ops[] = {
+    {"ih", "insert_head", setup_queue, call_insert_head, teardown_queue},
+    {"it", "insert_tail", setup_queue, call_insert_tail, teardown_queue},
+    {"rh", "remove_head", setup_queue_for_head, call_remove_head,
+     teardown_queue},
+    {"rt", "remove_tail", setup_queue_for_tail, call_remove_tail,
+     teardown_queue},
+    {"size", "size", setup_queue, call_size, teardown_queue},
+};
+
+static const dut_op_t *ops[DUT_MAX_OPS];
+static int nops = 0;
+
+/* Make sure the built-in operations come first in the table */
+static void register_builtins(void)
+{
+    if (nops)
+        return;
+    for (size_t i = 0; i < sizeof(builtin_ops) / sizeof(builtin_ops[0]); i++)
+        ops[nops++] = &builtin_ops[i];
+}
+
+bool dut_register(const dut_op_t *op)
+{
+    register_builtins();
+    if (nops == DUT_MAX_OPS || dut_find(op->name))
+        return false;
+    ops[nops++] = op;
+    return true;
+}
+
+const dut_op_t *dut_find(const char *name)
+{
+    register_builtins();
+    for (int i = 0; i < nops; i++) {
+        if (!strcmp(ops[i]->name, name))
+            return ops[i];
+    }
+    return NULL;
+}
+
+const dut_op_t *dut_get(int i)
+{
+    register_builtins();
+    return i >= 0 && i < nops ? ops[i] : NULL;
+}
+
 void measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
-             int mode)
-{
-    assert(mode == test_insert_tail || mode == test_size);
-    if (mode == test_insert_tail) {
-        for (size_t i = drop_size; i < number_measurements - drop_size; i++) {
-            char *s = get_random_string();
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            dut_insert_tail(s, 1);
-            after_ticks[i] = cpucycles();
-            dut_free();
-        }
-    } else {
-        for (size_t i = drop_size; i < number_measurements - drop_size; i++) {
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * chunk_size) % 10000);
-            before_ticks[i] = cpucycles();
-            dut_size(1);
-            after_ticks[i] = cpucycles();
-            dut_free();
-        }
+             size_t n,
+             const dut_op_t *op)
+{
+    for (size_t i = drop_size; i < n - drop_size; i++) {
+        op->setup(input_data + i * chunk_size);
+        before_ticks[i] = cpucycles();
+        op->call();
+        after_ticks[i] = cpucycles();
+        op->teardown();
     }
 }
@@ -1,6 +1,8 @@
 #ifndef DUDECT_CONSTANT_H
 #define DUDECT_CONSTANT_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #define dut_new() ((void) (q = q_new()))
 
@@ -26,11 +28,41 @@
 
 #define dut_free() ((void) (q_free(q)))
 
+/*
+ * An operation that can be tested for constant time.
+ * Before each measurement, setup prepares the queue from a chunk of input
+ * data, which starts with the same value for the fixed class of inputs.
+ * Only call is timed, and teardown then releases the queue.
+ */
+typedef struct {
+    char *name;
+    char *description;
+    void (*setup)(uint8_t *input);
+    void (*call)(void);
+    void (*teardown)(void);
+} dut_op_t;
+
+/* Maximum number of operations that can be registered */
+#define DUT_MAX_OPS 32
+
+/*
+ * Register another operation to be tested.
+ * Return false if the table is full or the name is taken.
+ */
+bool dut_register(const dut_op_t *op);
+
+/* Find registered operation by name.  Return NULL if there is none */
+const dut_op_t *dut_find(const char *name);
+
+/* Registered operation i, or NULL if i is out of range */
+const dut_op_t *dut_get(int i);
+
 void init_dut();
-void prepare_inputs(uint8_t *input_data, uint8_t *classes);
+void prepare_inputs(uint8_t *input_data, uint8_t *classes, size_t n);
 void measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
-             int mode);
+             size_t n,
+             const dut_op_t *op);
 
 #endif
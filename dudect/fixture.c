@@ -42,10 +42,44 @@
 #define enough_measurements 10000
 #define test_tries 10
 
+/*
+ * Tests run on each set of measurements: one on all of them, one for each
+ * cropping percentile, and the second order test.
+ */
+#define number_percentiles 100
+#define number_tests (1 + number_percentiles + 1)
+#define second_order_test (1 + number_percentiles)
+
+/* Measurements a test needs before its t value is taken into account */
+#define enough_per_test 500
+
+/* Measurements of the first test before the second order test starts */
+#define second_order_warmup 1000
+
 extern const int drop_size;
 extern const size_t chunk_size;
-extern const size_t number_measurements;
-static t_ctx *t;
+
+/* Measurements per batch, settable from qtest */
+int dudect_batch_size = 150;
+
+/*
+ * Buffers for a batch of measurements.  They are allocated once and kept
+ * across batches and tries, and only reallocated when the batch size
+ * changes.
+ */
+static struct {
+    size_t size; /* Measurements per batch */
+    int64_t *before_ticks;
+    int64_t *after_ticks;
+    int64_t *exec_times;
+    int64_t *sorted; /* Scratch space for computing percentiles */
+    uint8_t *classes;
+    uint8_t *input_data;
+} batch;
+
+static t_ctx t[number_tests];
+static int64_t percentiles[number_percentiles];
+static bool have_percentiles;
 
 /* threshold values for Welch's t-test */
 #define t_threshold_bananas                                                  \
@@ -62,38 +96,106 @@ static void differentiate(int64_t *exec_times,
                           int64_t *before_ticks,
                           int64_t *after_ticks)
 {
-    for (size_t i = 0; i < number_measurements; i++) {
+    for (size_t i = 0; i < batch.size; i++) {
         exec_times[i] = after_ticks[i] - before_ticks[i];
     }
 }
 
+static int cmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Set the cropping thresholds from the valid measurements of a batch.
+ * Threshold i keeps the fastest 1 - 0.5^(10 (i + 1) / number_percentiles)
+ * of the measurements, which spreads the thresholds over the fast end of
+ * the distribution, where most measurements are.
+ */
+static void prepare_percentiles(int64_t *exec_times)
+{
+    int64_t *sorted = batch.sorted;
+    size_t n = 0;
+    for (size_t i = 0; i < batch.size; i++) {
+        if (exec_times[i] > 0)
+            sorted[n++] = exec_times[i];
+    }
+    qsort(sorted, n, sizeof(int64_t), cmp);
+
+    for (size_t i = 0; i < number_percentiles; i++) {
+        double which =
+            1 - pow(0.5, 10 * (double) (i + 1) / number_percentiles);
+        size_t pos = (size_t) (which * n);
+        percentiles[i] = n ? sorted[pos < n ? pos : n - 1] : 0;
+    }
+}
+
 static void update_statistics(int64_t *exec_times, uint8_t *classes)
 {
-    for (size_t i = 0; i < number_measurements; i++) {
+    for (size_t i = 0; i < batch.size; i++) {
         int64_t difference = exec_times[i];
         /* Cpu cycle counter overflowed or dropped measurement */
         if (difference <= 0) {
             continue;
         }
+
         /* do a t-test on the execution time */
-        t_push(t, difference, classes[i]);
+        t_push(&t[0], difference, classes[i]);
+
+        /* do a t-test on cropped execution times, for several cropping
+         * thresholds.
+         */
+        for (size_t crop = 0; crop < number_percentiles; crop++) {
+            if (difference < percentiles[crop])
+                t_push(&t[crop + 1], difference, classes[i]);
+        }
+
+        /* do a second-order test (only if we have more than
+         * second_order_warmup measurements), on the squared distance of
+         * each time from the mean of its class.
+         */
+        if (t[0].n[0] + t[0].n[1] > second_order_warmup) {
+            double centered = difference - t[0].mean[classes[i]];
+            t_push(&t[second_order_test], centered * centered, classes[i]);
+        }
     }
 }
 
-static bool report(void)
+/* Test with the largest t value among those with enough measurements */
+static t_ctx *max_test(void)
 {
-    double max_t = fabs(t_compute(t));
-    double number_traces_max_t = t->n[0] + t->n[1];
-    double max_tau = max_t / sqrt(number_traces_max_t);
+    size_t ret = 0;
+    double max = 0;
+    for (size_t i = 0; i < number_tests; i++) {
+        if (t[i].n[0] + t[i].n[1] < enough_per_test || t[i].n[0] < 2 ||
+            t[i].n[1] < 2)
+            continue;
+        double x = fabs(t_compute(&t[i]));
+        if (max < x) {
+            max = x;
+            ret = i;
+        }
+    }
+    return &t[ret];
+}
 
+static bool report(void)
+{
+    double number_traces = t[0].n[0] + t[0].n[1];
     printf("\033[A\033[2K");
-    printf("meas: %7.2lf M, ", (number_traces_max_t / 1e6));
-    if (number_traces_max_t < enough_measurements) {
+    printf("meas: %7.2lf M, ", (number_traces / 1e6));
+    if (number_traces < enough_measurements) {
         printf("not enough measurements (%.0f still to go).\n",
-               enough_measurements - number_traces_max_t);
+               enough_measurements - number_traces);
         return false;
     }
 
+    t_ctx *test = max_test();
+    double max_t = fabs(t_compute(test));
+    double number_traces_max_t = test->n[0] + test->n[1];
+    double max_tau = max_t / sqrt(number_traces_max_t);
+
     /*
      * max_t: the t statistic value
      * max_tau: a t value normalized by sqrt(number of measurements).
@@ -117,32 +219,53 @@ static bool report(void)
     }
 }
 
-static bool doit(int mode)
+/* Make sure the batch buffers hold the configured number of measurements */
+static void prepare_batch(void)
 {
-    int64_t *before_ticks = calloc(number_measurements + 1, sizeof(int64_t));
-    int64_t *after_ticks = calloc(number_measurements + 1, sizeof(int64_t));
-    int64_t *exec_times = calloc(number_measurements, sizeof(int64_t));
-    uint8_t *classes = calloc(number_measurements, sizeof(uint8_t));
-    uint8_t *input_data =
-        calloc(number_measurements * chunk_size, sizeof(uint8_t));
-
-    if (!before_ticks || !after_ticks || !exec_times || !classes ||
-        !input_data) {
+    /* Leave measurements to time after dropping both ends of the batch */
+    size_t size = dudect_batch_size > 2 * drop_size
+                      ? (size_t) dudect_batch_size
+                      : (size_t) 2 * drop_size + 1;
+    if (size == batch.size)
+        return;
+
+    free(batch.before_ticks);
+    free(batch.after_ticks);
+    free(batch.exec_times);
+    free(batch.sorted);
+    free(batch.classes);
+    free(batch.input_data);
+
+    batch.size = size;
+    batch.before_ticks = calloc(size + 1, sizeof(int64_t));
+    batch.after_ticks = calloc(size + 1, sizeof(int64_t));
+    batch.exec_times = calloc(size, sizeof(int64_t));
+    batch.sorted = calloc(size, sizeof(int64_t));
+    batch.classes = calloc(size, sizeof(uint8_t));
+    batch.input_data = calloc(size * chunk_size, sizeof(uint8_t));
+
+    if (!batch.before_ticks || !batch.after_ticks || !batch.exec_times ||
+        !batch.sorted || !batch.classes || !batch.input_data) {
         die();
     }
+}
 
-    prepare_inputs(input_data, classes);
-
-    measure(before_ticks, after_ticks, input_data, mode);
-    differentiate(exec_times, before_ticks, after_ticks);
-    update_statistics(exec_times, classes);
-    bool ret = report();
+static bool doit(const dut_op_t *op)
+{
+    prepare_inputs(batch.input_data, batch.classes, batch.size);
 
-    free(before_ticks);
-    free(after_ticks);
-    free(exec_times);
-    free(classes);
-    free(input_data);
+    measure(batch.before_ticks, batch.after_ticks, batch.input_data,
+            batch.size, op);
+    differentiate(batch.exec_times, batch.before_ticks, batch.after_ticks);
+    /* The first batch only sets the cropping thresholds */
+    bool ret = false;
+    if (have_percentiles) {
+        update_statistics(batch.exec_times, batch.classes);
+        ret = report();
+    } else {
+        prepare_percentiles(batch.exec_times);
+        have_percentiles = true;
+    }
 
     return ret;
 }
@@ -150,46 +273,26 @@ static bool doit(int mode)
 static void init_once(void)
 {
     init_dut();
-    t_init(t);
+    for (size_t i = 0; i < number_tests; i++)
+        t_init(&t[i]);
+    have_percentiles = false;
 }
 
-bool is_insert_tail_const(void)
+bool is_const(const dut_op_t *op)
 {
     bool result = false;
-    t = malloc(sizeof(t_ctx));
-
-    for (int cnt = 0; cnt < test_tries; ++cnt) {
-        printf("Testing insert_tail...(%d/%d)\n\n", cnt, test_tries);
-        init_once();
-        for (int i = 0;
-             i <
-             enough_measurements / (number_measurements - drop_size * 2) + 1;
-             ++i)
-            result = doit(0);
-        printf("\033[A\033[2K\033[A\033[2K");
-        if (result == true)
-            break;
-    }
-    free(t);
-    return result;
-}
+    prepare_batch();
 
-bool is_size_const(void)
-{
-    bool result = false;
-    t = malloc(sizeof(t_ctx));
     for (int cnt = 0; cnt < test_tries; ++cnt) {
-        printf("Testing size...(%d/%d)\n\n", cnt, test_tries);
+        printf("Testing %s...(%d/%d)\n\n", op->description, cnt, test_tries);
         init_once();
-        for (int i = 0;
-             i <
-             enough_measurements / (number_measurements - drop_size * 2) + 1;
-             ++i)
-            result = doit(1);
+        /* One batch for the cropping thresholds, then enough to decide */
+        for (size_t i = 0;
+             i < enough_measurements / (batch.size - drop_size * 2) + 2; ++i)
+            result = doit(op);
         printf("\033[A\033[2K\033[A\033[2K");
         if (result == true)
             break;
     }
-    free(t);
     return result;
 }
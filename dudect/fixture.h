@@ -4,8 +4,10 @@
 #include <stdbool.h>
 #include "constant.h"
 
-/* Interface to test if function is constant */
-bool is_insert_tail_const(void);
-bool is_size_const(void);
+/* Measurements per batch.  At least 2 * drop_size + 1 are taken */
+extern int dudect_batch_size;
+
+/* Interface to test if a registered operation is constant time */
+bool is_const(const dut_op_t *op);
 
 #endif
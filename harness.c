@@ -1,7 +1,10 @@
 /* Test support code */
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,37 +32,63 @@
 
 /* Data structures used by our code */
 
-/*
- * Represent allocated blocks as doubly-linked list, with
- * next and prev pointers at beginning
- */
+/* Header placed in front of every allocated block */
 typedef struct BELE {
-    struct BELE *next, *prev;
     size_t payload_size;
     size_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_ele_t;
 
-static block_ele_t *allocated = NULL;
-static size_t allocated_count = 0;
+/*
+ * Each thread records the blocks it allocates in an arena of its own, so that
+ * threads do not contend on the bookkeeping.  An arena holds its blocks in an
+ * open-addressing hash table keyed by block address, so that cautious mode can
+ * tell whether a block is live in O(1) time.  Collisions are resolved with
+ * linear probing, and deletion shifts later entries back instead of leaving
+ * tombstones.
+ *
+ * A block freed by another thread is looked up in the other arenas, so every
+ * arena has a lock, which is only contended by such cross-thread frees.
+ * Arenas are never freed: when a thread exits, its arena, including blocks
+ * still allocated, is handed over to the next new thread.
+ */
+#define LIVE_MIN_BITS 10
+
+typedef struct ARENA {
+    pthread_mutex_t lock;
+    block_ele_t **table;
+    unsigned int bits;
+    size_t count;
+    bool attached; /* Is a thread using it?  Guarded by arenas_lock */
+    struct ARENA *next;
+} arena_t;
+
+/* All arenas ever created.  Arenas are only ever added at the front */
+static _Atomic(arena_t *) arenas = NULL;
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static __thread arena_t *thread_arena = NULL;
 
 /* Percent probability of malloc failure */
 int fail_probability = 0;
+static __thread unsigned int fail_seed;
 
 static bool cautious_mode = true;
 static bool noallocate_mode = false;
-static bool error_occurred = false;
-static char *error_message = "";
+/* Shared by all threads, so that errors in any thread show up in error_check */
+static atomic_bool error_occurred = false;
 
 static int time_limit = 1;
 
 /*
- * Data for managing exceptions
+ * Data for managing exceptions.  Each thread sets up its own.
  */
-static jmp_buf env;
-static volatile sig_atomic_t jmp_ready = false;
-static bool time_limited = false;
+static __thread char *error_message = "";
+static __thread sigjmp_buf env;
+static __thread volatile sig_atomic_t jmp_ready = false;
+static __thread bool time_limited = false;
 
 /*
  * Internal functions
@@ -68,12 +97,159 @@ static bool time_limited = false;
 /* Should this allocation fail? */
 static bool fail_allocation()
 {
-    double weight = (double) random() / RAND_MAX;
+    double weight = (double) rand_r(&fail_seed) / RAND_MAX;
     return (weight < 0.01 * fail_probability);
 }
 
+/* Home slot of block b in a table of 2^bits entries (Fibonacci hashing) */
+static inline size_t live_hash(block_ele_t *b, unsigned int bits)
+{
+    uint64_t h = (uint64_t) (uintptr_t) b * UINT64_C(0x9E3779B97F4A7C15);
+    return (size_t) (h >> (64 - bits));
+}
+
+/* Locate slot of arena a holding block b, or the empty slot where it goes */
+static size_t live_slot(arena_t *a, block_ele_t *b)
+{
+    size_t mask = ((size_t) 1 << a->bits) - 1;
+    size_t i = live_hash(b, a->bits);
+    while (a->table[i] && a->table[i] != b)
+        i = (i + 1) & mask;
+    return i;
+}
+
+/* Double the capacity of the table of arena a and rehash its entries */
+static bool live_grow(arena_t *a)
+{
+    unsigned int old_bits = a->bits;
+    block_ele_t **old_table = a->table;
+    size_t old_size = old_bits ? (size_t) 1 << old_bits : 0;
+
+    unsigned int bits = old_bits ? old_bits + 1 : LIVE_MIN_BITS;
+    block_ele_t **table = calloc((size_t) 1 << bits, sizeof(block_ele_t *));
+    if (!table)
+        return false;
+
+    a->table = table;
+    a->bits = bits;
+    for (size_t i = 0; i < old_size; i++) {
+        if (old_table[i])
+            a->table[live_slot(a, old_table[i])] = old_table[i];
+    }
+    free(old_table);
+    return true;
+}
+
+/*
+ * Record block b as allocated in arena a, which is locked.
+ * Return false if the table could not grow to make room for it
+ */
+static bool live_insert(arena_t *a, block_ele_t *b)
+{
+    /* Keep load factor at most 3/4 so that probe sequences stay short */
+    if ((!a->bits || a->count + 1 > ((size_t) 3 << a->bits) / 4) &&
+        !live_grow(a))
+        return false;
+    a->table[live_slot(a, b)] = b;
+    a->count++;
+    return true;
+}
+
 /*
- * Find header of block, given its payload.
+ * Forget block b in arena a, which is locked.
+ * Return false if it was not recorded as allocated there
+ */
+static bool live_remove(arena_t *a, block_ele_t *b)
+{
+    if (!a->bits)
+        return false;
+
+    size_t mask = ((size_t) 1 << a->bits) - 1;
+    size_t i = live_slot(a, b);
+    if (!a->table[i])
+        return false;
+
+    /* Shift back any entry whose probe sequence passes through slot i */
+    for (size_t j = (i + 1) & mask; a->table[j]; j = (j + 1) & mask) {
+        size_t k = live_hash(a->table[j], a->bits);
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+            a->table[i] = a->table[j];
+            i = j;
+        }
+    }
+    a->table[i] = NULL;
+    a->count--;
+    return true;
+}
+
+/* Hand the arena of an exiting thread over to threads created later */
+static void arena_detach(void *arg)
+{
+    arena_t *a = arg;
+    pthread_mutex_lock(&arenas_lock);
+    a->attached = false;
+    pthread_mutex_unlock(&arenas_lock);
+}
+
+static void arena_key_create()
+{
+    pthread_key_create(&arena_key, arena_detach);
+}
+
+/* Return the arena of the calling thread, attaching one if needed */
+static arena_t *arena_get()
+{
+    if (thread_arena)
+        return thread_arena;
+
+    pthread_once(&arena_once, arena_key_create);
+    pthread_mutex_lock(&arenas_lock);
+    arena_t *a;
+    for (a = atomic_load(&arenas); a && a->attached; a = a->next)
+        ;
+    if (!a) {
+        a = calloc(1, sizeof(arena_t));
+        if (!a) {
+            pthread_mutex_unlock(&arenas_lock);
+            report_event(MSG_FATAL, "Couldn't allocate any more memory");
+            exit(1);
+        }
+        pthread_mutex_init(&a->lock, NULL);
+        a->next = atomic_load(&arenas);
+        atomic_store(&arenas, a);
+    }
+    a->attached = true;
+    pthread_mutex_unlock(&arenas_lock);
+
+    pthread_setspecific(arena_key, a);
+    thread_arena = a;
+    fail_seed = (unsigned int) random();
+    return a;
+}
+
+/*
+ * Forget block b in whichever arena it was recorded, trying the arena of the
+ * calling thread first.  Return false if it was not recorded as allocated
+ */
+static bool arena_remove(block_ele_t *b)
+{
+    arena_t *mine = arena_get();
+    pthread_mutex_lock(&mine->lock);
+    bool found = live_remove(mine, b);
+    pthread_mutex_unlock(&mine->lock);
+
+    for (arena_t *a = atomic_load(&arenas); a && !found; a = a->next) {
+        if (a == mine)
+            continue;
+        pthread_mutex_lock(&a->lock);
+        found = live_remove(a, b);
+        pthread_mutex_unlock(&a->lock);
+    }
+    return found;
+}
+
+/*
+ * Find header of block, given its payload, and stop tracking it as allocated.
  * Signal error if doesn't seem like legitimate block
  */
 static block_ele_t *find_header(void *p)
@@ -84,15 +260,10 @@ static block_ele_t *find_header(void *p)
     }
 
     block_ele_t *b = (block_ele_t *) ((size_t) p - sizeof(block_ele_t));
+    bool live = arena_remove(b);
     if (cautious_mode) {
         /* Make sure this is really an allocated block */
-        block_ele_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
+        if (!live) {
             report_event(MSG_ERROR,
                          "Attempted to free unallocated block.  Address = %p",
                          p);
@@ -129,6 +300,7 @@ void *test_malloc(size_t size)
         return NULL;
     }
 
+    arena_t *a = arena_get();
     if (fail_allocation()) {
         report_event(MSG_WARN, "Malloc returning NULL");
         return NULL;
@@ -148,15 +320,15 @@ void *test_malloc(size_t size)
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->prev = NULL;
-
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
-    allocated_count++;
+    pthread_mutex_lock(&a->lock);
+    bool recorded = live_insert(a, new_block);
+    pthread_mutex_unlock(&a->lock);
+    if (!recorded) {
+        /* A block the harness cannot track must not be handed out */
+        report_event(MSG_WARN, "Malloc returning NULL");
+        free(new_block);
+        return NULL;
+    }
 
     return p;
 }
@@ -196,18 +368,7 @@ void test_free(void *p)
     *find_footer(b) = MAGICFREE;
     memset(p, FILLCHAR, b->payload_size);
 
-    /* Unlink from list */
-    block_ele_t *bn = b->next;
-    block_ele_t *bp = b->prev;
-    if (bp)
-        bp->next = bn;
-    else
-        allocated = bn;
-    if (bn)
-        bn->prev = bp;
-
     free(b);
-    allocated_count--;
 }
 
 // cppcheck-suppress unusedFunction
@@ -223,7 +384,13 @@ char *test_strdup(const char *s)
 
 size_t allocation_check()
 {
-    return allocated_count;
+    size_t count = 0;
+    for (arena_t *a = atomic_load(&arenas); a; a = a->next) {
+        pthread_mutex_lock(&a->lock);
+        count += a->count;
+        pthread_mutex_unlock(&a->lock);
+    }
+    return count;
 }
 
 /*
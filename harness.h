@@ -19,7 +19,7 @@ char *test_strdup(const char *s);
 
 #ifdef INTERNAL
 
-/* Report number of allocated blocks */
+/* Report number of allocated blocks, summed over all threads */
 size_t allocation_check();
 
 /* Probability of malloc failing, expressed as percent */
@@ -44,6 +44,8 @@ bool error_check();
 
 /*
  * Prepare for a risky operation using setjmp.
+ * Each thread has its own exception context, but the time limit uses alarm,
+ * so only one thread at a time should ask for it.
  * Function returns true for initial return, false for error return
  */
 bool exception_setup(bool limit_time);
@@ -1,12 +1,16 @@
 /* Implementation of testing code for queue code */
 
+#include <fcntl.h>
 #include <getopt.h>
+#include <math.h>
 #include <signal.h>
 #include <spawn.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h> /* strcasecmp */
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <time.h>
@@ -33,13 +37,13 @@
 
 #include "console.h"
 #include "report.h"
+#include "stress.h"
 
 /* Settable parameters */
 
 /*
  * How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the list
  */
 #define BIG_QUEUE 30
 static int big_queue_size = BIG_QUEUE;
@@ -58,6 +62,10 @@ static int fail_count = 0;
 
 static int string_length = MAXSTRING;
 
+/* Settings of the stress command */
+static int stress_mix = 100;
+static int stress_queue = 0;
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
@@ -69,11 +77,17 @@ static bool do_free(int argc, char *argv[]);
 static bool do_insert_head(int argc, char *argv[]);
 static bool do_insert_tail(int argc, char *argv[]);
 static bool do_remove_head(int argc, char *argv[]);
+static bool do_remove_tail(int argc, char *argv[]);
 static bool do_remove_head_quiet(int argc, char *argv[]);
 static bool do_reverse(int argc, char *argv[]);
 static bool do_size(int argc, char *argv[]);
 static bool do_sort(int argc, char *argv[]);
 static bool do_show(int argc, char *argv[]);
+static bool do_stress(int argc, char *argv[]);
+static bool do_complexity(int argc, char *argv[]);
+static bool do_const(int argc, char *argv[]);
+static bool do_record(int argc, char *argv[]);
+static bool do_replay(int argc, char *argv[]);
 
 static void queue_init();
 
@@ -90,6 +104,9 @@ static void console_init()
     add_cmd("rh", do_remove_head,
             " [str]          | Remove from head of queue.  Optionally compare "
             "to expected value str");
+    add_cmd("rt", do_remove_tail,
+            " [str]          | Remove from tail of queue.  Optionally compare "
+            "to expected value str");
     add_cmd(
         "rhq", do_remove_head_quiet,
         "                | Remove from head of queue without reporting value.");
@@ -98,12 +115,160 @@ static void console_init()
     add_cmd("size", do_size,
             " [n]            | Compute queue size n times (default: n == 1)");
     add_cmd("show", do_show, "                | Show queue contents");
+    add_cmd("stress", do_stress,
+            " p c ops        | Run p producer and c consumer threads on a "
+            "concurrent queue, ops operations per producer");
+    add_cmd("const", do_const,
+            " op             | Test if op (ih, it, rh, rt or size) runs in "
+            "constant time");
+    add_cmd("complexity", do_complexity,
+            " op min max     | Time op (ih, it, rh, rt, size, reverse, sort "
+            "or free) on queues of min to max elements and fit its growth");
+    add_cmd("record", do_record,
+            " [file]         | Record queue operations to binary trace file, "
+            "or stop recording");
+    add_cmd("replay", do_replay,
+            " [-d] file      | Run queue operations from binary trace file, "
+            "then delete it with -d");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
+    add_param("slab", &q_slab_nodes,
+              "Number of list elements per slab chunk (0 = no slab)", NULL);
+    add_param("intern", &q_intern,
+              "Share copies of equal long strings in new queues", NULL);
+    add_param("sortthreads", &q_sort_threads,
+              "Number of threads used to sort large queues", NULL);
+    add_param("sortalgo", &q_sort_algorithm,
+              "Sort algorithm (0 = merge sort, 1 = radix sort)", NULL);
+    add_param("constbatch", &dudect_batch_size,
+              "Measurements per batch of constant time tests", NULL);
+    add_param("stressmix", &stress_mix,
+              "Percent of producer operations in stress that are inserts",
+              NULL);
+    add_param("stressqueue", &stress_queue,
+              "Queue used by stress (0 = lock-free, 1 = blocking)", NULL);
+}
+
+/* Test registered operation op for constant time and report the verdict */
+static bool check_const(const dut_op_t *op)
+{
+    bool ok = is_const(op);
+    if (!ok) {
+        report(1, "ERROR: Probably not constant time");
+        return false;
+    }
+    report(1, "Probably constant time");
+    return ok;
+}
+
+static bool do_const(int argc, char *argv[])
+{
+    const dut_op_t *op = argc == 2 ? dut_find(argv[1]) : NULL;
+    if (!op) {
+        report_noreturn(1, "%s takes 1 argument, one of:", argv[0]);
+        for (int i = 0; (op = dut_get(i)); i++)
+            report_noreturn(1, " %s", op->name);
+        report(1, "");
+        return false;
+    }
+    return check_const(op);
+}
+
+/*
+ * Binary traces, written by record and run by replay.  A trace starts with
+ * trace_magic, followed by one record per operation: an opcode byte and its
+ * arguments, as LEB128 varints.  ih and it take a repetition count and a
+ * string, given as its length and its bytes, and size takes a repetition
+ * count.  Random strings are recorded as generated, one record each, so that
+ * replaying a trace inserts exactly the same strings.
+ */
+typedef enum {
+    TRACE_NEW = 1,
+    TRACE_FREE,
+    TRACE_IH,
+    TRACE_IT,
+    TRACE_RH,
+    TRACE_RT,
+    TRACE_RHQ,
+    TRACE_REVERSE,
+    TRACE_SIZE,
+    TRACE_SORT,
+} trace_op_t;
+
+static const char trace_magic[8] = "QTRACE1\n";
+
+/* Trace being recorded, or NULL */
+static FILE *trace_file = NULL;
+
+static void trace_varint(uint64_t v)
+{
+    while (v >= 0x80) {
+        fputc((int) (v & 0x7f) | 0x80, trace_file);
+        v >>= 7;
+    }
+    fputc((int) v, trace_file);
+}
+
+static void trace_op(trace_op_t op)
+{
+    if (trace_file)
+        fputc(op, trace_file);
+}
+
+static void trace_insert(bool at_tail, const char *s, int reps)
+{
+    if (!trace_file)
+        return;
+    size_t len = strlen(s);
+    fputc(at_tail ? TRACE_IT : TRACE_IH, trace_file);
+    trace_varint(reps);
+    trace_varint(len);
+    fwrite(s, 1, len, trace_file);
+}
+
+static void trace_size(int reps)
+{
+    if (!trace_file)
+        return;
+    fputc(TRACE_SIZE, trace_file);
+    trace_varint(reps);
+}
+
+/* Stop recording.  Return false if the trace could not be written */
+static bool trace_close()
+{
+    if (!trace_file)
+        return true;
+    bool ok = !ferror(trace_file);
+    ok = fclose(trace_file) == 0 && ok;
+    trace_file = NULL;
+    if (!ok)
+        report(1, "ERROR: Could not write trace file");
+    return ok;
+}
+
+static bool do_record(int argc, char *argv[])
+{
+    if (argc > 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    bool ok = trace_close();
+    if (argc == 1)
+        return ok;
+
+    trace_file = fopen(argv[1], "wb");
+    if (!trace_file) {
+        report(1, "ERROR: Could not open trace file '%s'", argv[1]);
+        return false;
+    }
+    fwrite(trace_magic, 1, sizeof(trace_magic), trace_file);
+    return ok;
 }
 
 static bool do_new(int argc, char *argv[])
@@ -119,6 +284,7 @@ static bool do_new(int argc, char *argv[])
         ok = do_free(argc, argv);
     }
     error_check();
+    trace_op(TRACE_NEW);
 
     if (exception_setup(true))
         q = q_new();
@@ -140,13 +306,11 @@ static bool do_free(int argc, char *argv[])
     if (!q)
         report(3, "Warning: Calling free on null queue");
     error_check();
+    trace_op(TRACE_FREE);
 
-    if (qcnt > big_queue_size)
-        set_cautious_mode(false);
     if (exception_setup(true))
         q_free(q);
     exception_cancel();
-    set_cautious_mode(true);
 
     q = NULL;
     qcnt = 0;
@@ -177,6 +341,102 @@ static void fill_rand_string(char *buf, size_t buf_size)
     buf[len] = '\0';
 }
 
+/*
+ * Check the string saved in the element at head of queue.
+ * If inserts is non-NULL, it is the string just inserted, which must have
+ * been copied.  If lasts is non-NULL, it is the string saved in the
+ * previously inserted element, which must be a different copy.
+ */
+static bool check_head_copy(char *inserts, char *lasts)
+{
+    list_ele_t *head = q_first(q);
+    char *saved = head->value;
+    if (!saved) {
+        report(1, "ERROR: Failed to save copy of string in list");
+        return false;
+    }
+    if (inserts && inserts == saved) {
+        report(1,
+               "ERROR: Need to allocate and copy string for new list element");
+        return false;
+    }
+    if (inserts && strcmp(inserts, saved)) {
+        /* Inline and allocated copies must both be complete */
+        report(1, "ERROR: Saved copy %s of string %s in list is incorrect",
+               saved, inserts);
+        return false;
+    }
+    /* Only interning queues may share long strings between elements */
+    if (lasts && lasts == saved && !(q->intern && !q_ele_inline(head))) {
+        report(1,
+               "ERROR: Need to allocate separate string for each list "
+               "element");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Random strings for a bulk insertion.  They are made, and freed, outside
+ * the exception_setup region, since a time limit exception would skip
+ * freeing them.
+ */
+typedef struct {
+    char *pool;
+    char **sv;
+} rand_strings_t;
+
+/* Make reps random strings.  Leave sv NULL if they could not be allocated */
+static void rand_strings_fill(rand_strings_t *rs, int reps)
+{
+    rs->pool = malloc((size_t) reps * MAX_RANDSTR_LEN);
+    rs->sv = malloc(reps * sizeof(char *));
+    if (!rs->pool || !rs->sv) {
+        free(rs->pool);
+        free(rs->sv);
+        rs->pool = NULL;
+        rs->sv = NULL;
+        return;
+    }
+    for (int r = 0; r < reps; r++) {
+        rs->sv[r] = rs->pool + (size_t) r * MAX_RANDSTR_LEN;
+        fill_rand_string(rs->sv[r], MAX_RANDSTR_LEN);
+    }
+}
+
+static void rand_strings_free(rand_strings_t *rs)
+{
+    free(rs->sv);
+    free(rs->pool);
+}
+
+/*
+ * Insert reps copies of inserts, or the reps strings of rs when it is
+ * non-NULL, at head or tail of queue with a single bulk call.
+ * Return false if the bulk call failed, in which case the queue is unchanged
+ * and the caller falls back to inserting one string at a time.
+ */
+static bool insert_bulk(bool at_tail,
+                        char *inserts,
+                        rand_strings_t *rs,
+                        int reps)
+{
+    bool rval = false;
+    if (!rs) {
+        rval = at_tail ? q_insert_tail_n(q, inserts, reps)
+                       : q_insert_head_n(q, inserts, reps);
+    } else if (rs->sv) {
+        rval = at_tail ? q_insert_tail_array(q, rs->sv, reps)
+                       : q_insert_head_array(q, rs->sv, reps);
+        for (int r = 0; rval && r < reps; r++)
+            trace_insert(at_tail, rs->sv[r], 1);
+    }
+
+    if (rval)
+        qcnt += reps;
+    return rval;
+}
+
 static bool do_insert_head(int argc, char *argv[])
 {
     char *lasts = NULL;
@@ -204,31 +464,34 @@ static bool do_insert_head(int argc, char *argv[])
     if (!q)
         report(3, "Warning: Calling insert head on null queue");
     error_check();
+    if (!need_rand)
+        trace_insert(false, inserts, reps);
+
+    rand_strings_t rs = {NULL, NULL};
+    if (need_rand && reps > 1)
+        rand_strings_fill(&rs, reps);
 
     if (exception_setup(true)) {
+        if (reps > 1 &&
+            insert_bulk(false, inserts, need_rand ? &rs : NULL, reps)) {
+            ok = check_head_copy(need_rand ? NULL : inserts,
+                                 q_next(q, q_first(q))->value) &&
+                 !error_check();
+            reps = 0;
+        }
         for (int r = 0; ok && r < reps; r++) {
-            if (need_rand)
+            if (need_rand) {
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
+                trace_insert(false, randstr_buf, 1);
+            }
             bool rval = q_insert_head(q, inserts);
             if (rval) {
                 qcnt++;
-                if (!q->head->value) {
-                    report(1, "ERROR: Failed to save copy of string in list");
-                    ok = false;
-                } else if (r == 0 && inserts == q->head->value) {
-                    report(1,
-                           "ERROR: Need to allocate and copy string for new "
-                           "list element");
-                    ok = false;
-                    break;
-                } else if (r == 1 && lasts == q->head->value) {
-                    report(1,
-                           "ERROR: Need to allocate separate string for each "
-                           "list element");
-                    ok = false;
+                ok = check_head_copy(r == 0 ? inserts : NULL,
+                                     r == 1 ? lasts : NULL);
+                if (!ok)
                     break;
-                }
-                lasts = q->head->value;
+                lasts = q_first(q)->value;
             } else {
                 fail_count++;
                 if (fail_count < fail_limit)
@@ -244,6 +507,7 @@ static bool do_insert_head(int argc, char *argv[])
         }
     }
     exception_cancel();
+    rand_strings_free(&rs);
 
     show_queue(3);
     return ok;
@@ -256,13 +520,7 @@ static bool do_insert_tail(int argc, char *argv[])
             report(1, "%s does not need arguments in simulation mode", argv[0]);
             return false;
         }
-        bool ok = is_insert_tail_const();
-        if (!ok) {
-            report(1, "ERROR: Probably not constant time");
-            return false;
-        }
-        report(1, "Probably constant time");
-        return ok;
+        return check_const(dut_find("it"));
     }
 
     char randstr_buf[MAX_RANDSTR_LEN];
@@ -289,15 +547,32 @@ static bool do_insert_tail(int argc, char *argv[])
     if (!q)
         report(3, "Warning: Calling insert tail on null queue");
     error_check();
+    if (!need_rand)
+        trace_insert(true, inserts, reps);
+
+    rand_strings_t rs = {NULL, NULL};
+    if (need_rand && reps > 1)
+        rand_strings_fill(&rs, reps);
 
     if (exception_setup(true)) {
+        if (reps > 1 &&
+            insert_bulk(true, inserts, need_rand ? &rs : NULL, reps)) {
+            if (!q_last(q)->value) {
+                report(1, "ERROR: Failed to save copy of string in list");
+                ok = false;
+            }
+            ok = ok && !error_check();
+            reps = 0;
+        }
         for (int r = 0; ok && r < reps; r++) {
-            if (need_rand)
+            if (need_rand) {
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
+                trace_insert(true, randstr_buf, 1);
+            }
             bool rval = q_insert_tail(q, inserts);
             if (rval) {
                 qcnt++;
-                if (!q->head->value) {
+                if (!q_last(q)->value) {
                     report(1, "ERROR: Failed to save copy of string in list");
                     ok = false;
                 }
@@ -316,12 +591,18 @@ static bool do_insert_tail(int argc, char *argv[])
         }
     }
     exception_cancel();
+    rand_strings_free(&rs);
     show_queue(3);
     return ok;
 }
 
-static bool do_remove_head(int argc, char *argv[])
+/*
+ * Remove element from head of queue, or from its tail if from_tail is set,
+ * and check the removed value.
+ */
+static bool do_remove(bool from_tail, int argc, char *argv[])
 {
+    char *end = from_tail ? "tail" : "head";
     if (argc != 1 && argc != 2) {
         report(1, "%s needs 0-1 arguments", argv[0]);
         return false;
@@ -354,14 +635,17 @@ static bool do_remove_head(int argc, char *argv[])
     removes[string_length + STRINGPAD] = '\0';
 
     if (!q)
-        report(3, "Warning: Calling remove head on null queue");
+        report(3, "Warning: Calling remove %s on null queue", end);
     else if (!q->head)
-        report(3, "Warning: Calling remove head on empty queue");
+        report(3, "Warning: Calling remove %s on empty queue", end);
     error_check();
+    trace_op(from_tail ? TRACE_RT : TRACE_RH);
 
     bool rval = false;
-    if (exception_setup(true))
-        rval = q_remove_head(q, removes, string_length + 1);
+    if (exception_setup(true)) {
+        rval = from_tail ? q_remove_tail(q, removes, string_length + 1)
+                         : q_remove_head(q, removes, string_length + 1);
+    }
     exception_cancel();
 
     if (rval) {
@@ -380,8 +664,9 @@ static bool do_remove_head(int argc, char *argv[])
             i++;
         if (i != string_length + STRINGPAD) {
             report(1,
-                   "ERROR: copying of string in remove_head overflowed "
-                   "destination buffer.");
+                   "ERROR: copying of string in remove_%s overflowed "
+                   "destination buffer.",
+                   end);
             ok = false;
         } else {
             report(2, "Removed %s from queue", removes);
@@ -411,6 +696,16 @@ static bool do_remove_head(int argc, char *argv[])
     return ok && !error_check();
 }
 
+static bool do_remove_head(int argc, char *argv[])
+{
+    return do_remove(false, argc, argv);
+}
+
+static bool do_remove_tail(int argc, char *argv[])
+{
+    return do_remove(true, argc, argv);
+}
+
 static bool do_remove_head_quiet(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -424,6 +719,7 @@ static bool do_remove_head_quiet(int argc, char *argv[])
     else if (!q->head)
         report(3, "Warning: Calling remove head on empty queue");
     error_check();
+    trace_op(TRACE_RHQ);
 
     bool rval = false;
     if (exception_setup(true))
@@ -457,6 +753,7 @@ static bool do_reverse(int argc, char *argv[])
     if (!q)
         report(3, "Warning: Calling reverse on null queue");
     error_check();
+    trace_op(TRACE_REVERSE);
 
     set_noallocate_mode(true);
     if (exception_setup(true))
@@ -475,13 +772,7 @@ static bool do_size(int argc, char *argv[])
             report(1, "%s does not need arguments in simulation mode", argv[0]);
             return false;
         }
-        bool ok = is_size_const();
-        if (!ok) {
-            report(1, "ERROR: Probably not constant time");
-            return false;
-        }
-        report(1, "Probably constant time");
-        return ok;
+        return check_const(dut_find("size"));
     }
 
     if (argc != 1 && argc != 2) {
@@ -506,6 +797,7 @@ static bool do_size(int argc, char *argv[])
     if (!q)
         report(3, "Warning: Calling size on null queue");
     error_check();
+    trace_size(reps);
 
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
@@ -546,6 +838,7 @@ bool do_sort(int argc, char *argv[])
     if (cnt < 2)
         report(3, "Warning: Calling sort on single node");
     error_check();
+    trace_op(TRACE_SORT);
 
     set_noallocate_mode(true);
     if (exception_setup(true))
@@ -555,10 +848,10 @@ bool do_sort(int argc, char *argv[])
 
     bool ok = true;
     if (q) {
-        for (list_ele_t *e = q->head; e && --cnt; e = e->next) {
+        for (list_ele_t *e = q_first(q); e && --cnt; e = q_next(q, e)) {
             /* Ensure each element in ascending order */
             /* FIXME: add an option to specify sorting order */
-            if (strcasecmp(e->value, e->next->value) > 0) {
+            if (strcasecmp(e->value, q_next(q, e)->value) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
                 break;
@@ -583,12 +876,12 @@ static bool show_queue(int vlevel)
     }
 
     report_noreturn(vlevel, "q = [");
-    list_ele_t *e = q->head;
+    list_ele_t *e = q_first(q);
     if (exception_setup(true)) {
         while (ok && e && cnt < qcnt) {
             if (cnt < big_queue_size)
                 report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
-            e = e->next;
+            e = q_next(q, e);
             cnt++;
             ok = ok && !error_check();
         }
@@ -626,6 +919,477 @@ static bool do_show(int argc, char *argv[])
     return show_queue(0);
 }
 
+/* Concurrent stress test, see stress.h */
+static bool do_stress(int argc, char *argv[])
+{
+    int producers, consumers, ops;
+    if (argc != 4 || !get_int(argv[1], &producers) ||
+        !get_int(argv[2], &consumers) || !get_int(argv[3], &ops) ||
+        producers < 1 || consumers < 0 || ops < 1) {
+        report(1, "%s takes 3 arguments: producers (>= 1), consumers (>= 0) "
+                  "and operations per producer (>= 1)",
+               argv[0]);
+        return false;
+    }
+
+    stress_run_t run = {
+        .queue = stress_queue ? STRESS_BLOCKING : STRESS_LOCKFREE,
+        .producers = producers,
+        .consumers = consumers,
+        .ops = ops,
+        .mix = stress_mix,
+        .latency = true,
+    };
+    bool ok = stress_run(&run);
+    /* Nothing ran if the test could not be set up */
+    if (!run.threads)
+        return false;
+
+    int nthreads = producers + consumers;
+    long total = 0;
+    size_t nlat = 0;
+    report(1, "Thread      Ops      Ops/sec");
+    for (int i = 0; i < nthreads; i++) {
+        stress_thread_t *t = &run.threads[i];
+        report(1, "%c%-3d %11ld %12.0f", t->producer ? 'p' : 'c', t->id, t->ops,
+               t->elapsed > 0 ? t->ops / t->elapsed : 0);
+        total += t->ops;
+        nlat += t->nlat;
+    }
+    report(1, "Total %10ld %12.0f (%.3f s)", total,
+           run.elapsed > 0 ? total / run.elapsed : 0, run.elapsed);
+
+    uint64_t *lat = malloc((nlat ? nlat : 1) * sizeof(uint64_t));
+    if (lat && nlat) {
+        nlat = 0;
+        for (int i = 0; i < nthreads; i++) {
+            memcpy(lat + nlat, run.threads[i].lat,
+                   run.threads[i].nlat * sizeof(uint64_t));
+            nlat += run.threads[i].nlat;
+        }
+        sort_samples(lat, nlat);
+        report(1, "Latency (ns): p50 %lu, p99 %lu, p999 %lu",
+               (unsigned long) sample_percentile(lat, nlat, 0.50),
+               (unsigned long) sample_percentile(lat, nlat, 0.99),
+               (unsigned long) sample_percentile(lat, nlat, 0.999));
+    }
+    free(lat);
+
+    if (run.leftover)
+        report(2, "Removed %ld elements left in queue", run.leftover);
+    stress_done(&run);
+    return ok;
+}
+
+/*
+ * Empirical complexity estimation.
+ *
+ * An operation is timed on private queues over a geometric sweep of sizes.
+ * The median time at each size is then fitted to c * f(n) for each candidate
+ * growth function f, minimizing the squared errors relative to the measured
+ * times, so that every size weighs the same and cache effects at the largest
+ * sizes do not dominate.  The function leaving the smallest root-mean-square
+ * relative error is the best fit.
+ */
+
+/* Timed runs of an operation at each size */
+#define CPLX_TRIALS 5 /* Operations that need a new queue for every run */
+#define CPLX_REPS 101 /* Other operations */
+#define CPLX_MIN_POINTS 6 /* Fewest sizes to sweep over */
+#define CPLX_MAX_POINTS 64
+
+typedef enum {
+    CPLX_IH,
+    CPLX_IT,
+    CPLX_RH,
+    CPLX_RT,
+    CPLX_SIZE,
+    CPLX_REVERSE,
+    CPLX_SORT,
+    CPLX_FREE,
+    CPLX_NOPS
+} cplx_op_t;
+
+static char *cplx_op_names[CPLX_NOPS] = {"ih",   "it",      "rh",   "rt",
+                                         "size", "reverse", "sort", "free"};
+
+typedef enum {
+    CPLX_1,
+    CPLX_LOGN,
+    CPLX_N,
+    CPLX_NLOGN,
+    CPLX_N2,
+    CPLX_NMODELS
+} cplx_model_t;
+
+static char *cplx_model_names[CPLX_NMODELS] = {"O(1)", "O(log n)", "O(n)",
+                                               "O(n log n)", "O(n^2)"};
+
+static double cplx_model(cplx_model_t m, double n)
+{
+    switch (m) {
+    case CPLX_1:
+        return 1;
+    case CPLX_LOGN:
+        return log2(n);
+    case CPLX_N:
+        return n;
+    case CPLX_NLOGN:
+        return n * log2(n);
+    default:
+        return n * n;
+    }
+}
+
+/* Create a queue of n random strings.  Return NULL on failure */
+static queue_t *cplx_fill(int n)
+{
+    queue_t *cq = q_new();
+    char buf[MAX_RANDSTR_LEN];
+    for (int i = 0; cq && i < n; i++) {
+        fill_rand_string(buf, sizeof(buf));
+        if (!q_insert_tail(cq, buf)) {
+            q_free(cq);
+            cq = NULL;
+        }
+    }
+    return cq;
+}
+
+/*
+ * Store in *ns the median time in nanoseconds of operation op on a queue of n
+ * elements.  Operations on one element are undone after each run, so that the
+ * queue keeps its size, and sort and free get a new random queue for every
+ * run.  Return false on failure
+ */
+static bool cplx_measure(cplx_op_t op, int n, double *ns)
+{
+    uint64_t samples[CPLX_REPS];
+    bool fresh = op == CPLX_SORT || op == CPLX_FREE;
+    int runs = fresh ? CPLX_TRIALS : CPLX_REPS;
+    char buf[MAX_RANDSTR_LEN];
+    queue_t *cq = NULL;
+
+    for (int r = 0; r < runs; r++) {
+        if (!cq && !(cq = cplx_fill(n)))
+            return false;
+        fill_rand_string(buf, sizeof(buf));
+        bool ok = true;
+        uint64_t t0 = time_ns();
+        switch (op) {
+        case CPLX_IH:
+            ok = q_insert_head(cq, buf);
+            break;
+        case CPLX_IT:
+            ok = q_insert_tail(cq, buf);
+            break;
+        case CPLX_RH:
+            ok = q_remove_head(cq, NULL, 0);
+            break;
+        case CPLX_RT:
+            ok = q_remove_tail(cq, NULL, 0);
+            break;
+        case CPLX_SIZE:
+            q_size(cq);
+            break;
+        case CPLX_REVERSE:
+            q_reverse(cq);
+            break;
+        case CPLX_SORT:
+            q_sort(cq);
+            break;
+        default:
+            q_free(cq);
+            cq = NULL;
+            break;
+        }
+        samples[r] = time_ns() - t0;
+
+        if (op == CPLX_IH)
+            ok = ok && q_remove_head(cq, NULL, 0);
+        else if (op == CPLX_IT)
+            ok = ok && q_remove_tail(cq, NULL, 0);
+        else if (op == CPLX_RH)
+            ok = ok && q_insert_head(cq, buf);
+        else if (op == CPLX_RT)
+            ok = ok && q_insert_tail(cq, buf);
+        else if (fresh) {
+            q_free(cq);
+            cq = NULL;
+        }
+        if (!ok) {
+            q_free(cq);
+            return false;
+        }
+    }
+    q_free(cq);
+
+    sort_samples(samples, runs);
+    *ns = sample_percentile(samples, runs, 0.5);
+    return true;
+}
+
+static bool do_complexity(int argc, char *argv[])
+{
+    int op, min_n, max_n;
+    for (op = 0; op < CPLX_NOPS; op++) {
+        if (argc == 4 && !strcmp(argv[1], cplx_op_names[op]))
+            break;
+    }
+    if (argc != 4 || op == CPLX_NOPS || !get_int(argv[2], &min_n) ||
+        !get_int(argv[3], &max_n) || min_n < 1 || max_n <= min_n) {
+        report(1,
+               "%s takes 3 arguments: an operation (ih, it, rh, rt, size, "
+               "reverse, sort or free) and queue sizes 1 <= min < max",
+               argv[0]);
+        return false;
+    }
+
+    /* Double the size each step, unless that gives too few sizes */
+    double ratio = 2;
+    if (log2((double) max_n / min_n) < CPLX_MIN_POINTS - 1)
+        ratio = pow((double) max_n / min_n, 1.0 / (CPLX_MIN_POINTS - 1));
+    int sizes[CPLX_MAX_POINTS];
+    int npoints = 0;
+    for (double x = min_n; npoints < CPLX_MAX_POINTS; x *= ratio) {
+        int n = x < max_n ? (int) lround(x) : max_n;
+        if (!npoints || n > sizes[npoints - 1])
+            sizes[npoints++] = n;
+        if (n == max_n)
+            break;
+    }
+
+    /* Measure speed, not how the queue copes with allocation failures */
+    int saved_fail_probability = fail_probability;
+    fail_probability = 0;
+    size_t baseline = allocation_check();
+    double times[CPLX_MAX_POINTS];
+    bool ok = true;
+    int i;
+    report(2, "%12s %14s", "n", "ns");
+    for (i = 0; i < npoints; i++) {
+        ok = cplx_measure(op, sizes[i], &times[i]);
+        if (!ok)
+            break;
+        report(2, "%12d %14.0f", sizes[i], times[i]);
+    }
+    fail_probability = saved_fail_probability;
+
+    if (!ok) {
+        report(1, "ERROR: Could not run %s on a queue of %d elements",
+               argv[1], sizes[i]);
+        return false;
+    }
+    if (allocation_check() != baseline) {
+        report(1, "ERROR: %lu blocks still allocated after measurement",
+               (unsigned long) (allocation_check() - baseline));
+        ok = false;
+    }
+
+    int best = 0;
+    double best_rms = INFINITY;
+    report(2, "%-12s %14s %10s", "Model", "Coefficient", "RMS");
+    for (int m = 0; m < CPLX_NMODELS; m++) {
+        /* Least squares for the errors relative to the times */
+        double sum_f = 0, sum_ff = 0;
+        for (int i = 0; i < npoints; i++) {
+            double f = cplx_model(m, sizes[i]) / times[i];
+            sum_f += f;
+            sum_ff += f * f;
+        }
+        double coef = sum_ff > 0 ? sum_f / sum_ff : 0;
+        double sq = 0;
+        for (int i = 0; i < npoints; i++) {
+            double err = 1 - coef * cplx_model(m, sizes[i]) / times[i];
+            sq += err * err;
+        }
+        double rms = sqrt(sq / npoints);
+        report(2, "%-12s %14.4g %9.1f%%", cplx_model_names[m], coef,
+               100 * rms);
+        if (rms < best_rms) {
+            best = m;
+            best_rms = rms;
+        }
+    }
+    report(1, "%s: best fit %s, RMS relative error %.1f%%", argv[1],
+           cplx_model_names[best], 100 * best_rms);
+
+    return ok;
+}
+
+/* Trace being replayed */
+static struct {
+    const uint8_t *pos;
+    const uint8_t *end;
+    char *buf; /* Removed strings */
+    size_t bufsize;
+    char *str; /* Strings to insert */
+    size_t strsize;
+    size_t nops; /* Operations run so far */
+} replay;
+
+static bool replay_varint(uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; replay.pos < replay.end && shift < 64; shift += 7) {
+        uint8_t b = *replay.pos++;
+        *v |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/* Read a string argument into replay.str */
+static bool replay_string()
+{
+    uint64_t len;
+    if (!replay_varint(&len) || len > (uint64_t) (replay.end - replay.pos))
+        return false;
+    if (len + 1 > replay.strsize) {
+        char *str = realloc(replay.str, len + 1);
+        if (!str)
+            return false;
+        replay.str = str;
+        replay.strsize = len + 1;
+    }
+    memcpy(replay.str, replay.pos, len);
+    replay.str[len] = '\0';
+    replay.pos += len;
+    return true;
+}
+
+/*
+ * Run the operations of the trace, calling the queue functions directly.
+ * Return false if the trace is malformed.
+ */
+static bool replay_run()
+{
+    while (replay.pos < replay.end) {
+        trace_op_t op = *replay.pos++;
+        uint64_t reps;
+        switch (op) {
+        case TRACE_NEW:
+            q_free(q);
+            q = q_new();
+            qcnt = 0;
+            break;
+        case TRACE_FREE:
+            q_free(q);
+            q = NULL;
+            qcnt = 0;
+            break;
+        case TRACE_IH:
+        case TRACE_IT:
+            if (!replay_varint(&reps) || !replay_string())
+                return false;
+            for (uint64_t r = 0; r < reps; r++) {
+                if (op == TRACE_IH ? q_insert_head(q, replay.str)
+                                   : q_insert_tail(q, replay.str))
+                    qcnt++;
+            }
+            break;
+        case TRACE_RH:
+            if (q_remove_head(q, replay.buf, replay.bufsize))
+                qcnt--;
+            break;
+        case TRACE_RT:
+            if (q_remove_tail(q, replay.buf, replay.bufsize))
+                qcnt--;
+            break;
+        case TRACE_RHQ:
+            if (q_remove_head(q, NULL, 0))
+                qcnt--;
+            break;
+        case TRACE_REVERSE:
+            q_reverse(q);
+            break;
+        case TRACE_SIZE:
+            if (!replay_varint(&reps))
+                return false;
+            for (uint64_t r = 0; r < reps; r++)
+                q_size(q);
+            break;
+        case TRACE_SORT:
+            q_sort(q);
+            break;
+        default:
+            return false;
+        }
+        replay.nops++;
+    }
+    return true;
+}
+
+static bool do_replay(int argc, char *argv[])
+{
+    bool delete = argc == 3 && !strcmp(argv[1], "-d");
+    if (argc != 2 && !delete) {
+        report(1, "%s takes 1 argument, optionally preceded by -d", argv[0]);
+        return false;
+    }
+
+    char *path = argv[argc - 1];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 ||
+        st.st_size < (off_t) sizeof(trace_magic)) {
+        report(1, "ERROR: Could not read trace file '%s'", path);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        report(1, "ERROR: Could not map trace file '%s'", path);
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    if (memcmp(map, trace_magic, sizeof(trace_magic))) {
+        report(1, "ERROR: '%s' is not a trace file", path);
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    replay.pos = map + sizeof(trace_magic);
+    replay.end = map + st.st_size;
+    replay.bufsize = string_length + 1;
+    replay.buf = malloc(replay.bufsize);
+    replay.str = NULL;
+    replay.strsize = 0;
+    replay.nops = 0;
+    if (!replay.buf) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for strings");
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    error_check();
+    bool ok = false;
+    uint64_t start = time_ns();
+    if (exception_setup(false))
+        ok = replay_run();
+    exception_cancel();
+    uint64_t elapsed = time_ns() - start;
+
+    if (!ok && !error_check())
+        report(1, "ERROR: Malformed trace at offset %ld",
+               (long) (replay.pos - map));
+    report(1, "Replayed %zu operations in %.3f s (%.0f ops/sec)", replay.nops,
+           elapsed * 1e-9, elapsed ? replay.nops * 1e9 / elapsed : 0.0);
+
+    free(replay.buf);
+    free(replay.str);
+    munmap(map, st.st_size);
+    if (delete && unlink(path) != 0) {
+        report(1, "ERROR: Could not delete trace file '%s'", path);
+        ok = false;
+    }
+    show_queue(3);
+    return ok && !error_check();
+}
+
 /* Signal handlers */
 static void sigsegvhandler(int sig)
 {
@@ -653,14 +1417,11 @@ static void queue_init()
 
 static bool queue_quit(int argc, char *argv[])
 {
+    bool ok = trace_close();
     report(3, "Freeing queue");
-    if (qcnt > big_queue_size)
-        set_cautious_mode(false);
-
     if (exception_setup(true))
         q_free(q);
     exception_cancel();
-    set_cautious_mode(true);
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -669,7 +1430,7 @@ static bool queue_quit(int argc, char *argv[])
         return false;
     }
 
-    return true;
+    return ok;
 }
 
 static void usage(char *cmd)
@@ -1,10 +1,223 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "harness.h"
 #include "queue.h"
 
+/*
+ * Slab allocation is off until enabled with 'option slab', so that by
+ * default the harness checks every list element for leaks and double frees
+ */
+int q_slab_nodes = 0;
+
+/* Initial number of slots in a string intern table, as a power of 2 */
+#define INTERN_MIN_BITS 6
+
+int q_intern = 0;
+
+/* Upper limit on the number of threads used by q_sort */
+#define MAX_SORT_THREADS 64
+
+/* Smallest number of elements worth handing to a sort thread */
+#define SORT_MIN_PER_THREAD 4096
+
+int q_sort_threads = 1;
+
+/* Buckets smaller than this are left to merge sort by the radix sort */
+#define RADIX_MIN_BUCKET 32
+
+/* Deepest string position the radix sort distributes on */
+#define RADIX_MAX_DEPTH 16
+
+int q_sort_algorithm = Q_SORT_MERGE;
+
+/*
+ * Add a new chunk of nr list elements to the slab allocator of q.
+ * Elements left uncarved in the previous chunk move to the free list.
+ * Return false if could not allocate space.
+ */
+static bool slab_grow(queue_t *q, int nr)
+{
+    slab_t *slab = malloc(sizeof(slab_t) + nr * sizeof(list_ele_t));
+    if (!slab)
+        return false;
+
+    if (q->slabs) {
+        while (q->slab_unused) {
+            list_ele_t *e = &q->slabs->nodes[q->slabs->nr - q->slab_unused--];
+            e->next = q->free_nodes;
+            q->free_nodes = e;
+            q->free_count++;
+        }
+    }
+
+    slab->nr = nr;
+    slab->next = q->slabs;
+    q->slabs = slab;
+    q->slab_unused = nr;
+    return true;
+}
+
+/*
+ * Make sure the next n calls to node_alloc will succeed, using a single
+ * chunk for whatever the slab allocator cannot provide yet.
+ * Return false if could not allocate space.
+ */
+static bool slab_reserve(queue_t *q, int n)
+{
+    if (q->slab_nodes <= 0)
+        return true;
+
+    int need = n - q->free_count - q->slab_unused;
+    if (need <= 0)
+        return true;
+    return slab_grow(q, need > q->slab_nodes ? need : q->slab_nodes);
+}
+
+/*
+ * Get storage for a list element, either from the slab allocator or
+ * directly from malloc.
+ * Return NULL if could not allocate space.
+ */
+static list_ele_t *node_alloc(queue_t *q)
+{
+    if (q->slab_nodes <= 0)
+        return malloc(sizeof(list_ele_t));
+
+    list_ele_t *e = q->free_nodes;
+    if (e) {
+        q->free_nodes = e->next;
+        q->free_count--;
+        return e;
+    }
+
+    if (!q->slab_unused && !slab_grow(q, q->slab_nodes))
+        return NULL;
+    return &q->slabs->nodes[q->slabs->nr - q->slab_unused--];
+}
+
+/* Give back storage of a list element obtained from node_alloc */
+static void node_release(queue_t *q, list_ele_t *e)
+{
+    if (q->slab_nodes <= 0) {
+        free(e);
+        return;
+    }
+    e->next = q->free_nodes;
+    q->free_nodes = e;
+    q->free_count++;
+}
+
+/* Hash a string of len characters (FNV-1a) */
+static uint64_t str_hash(const char *s, size_t len)
+{
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= UINT64_C(0x100000001b3);
+    }
+    return h;
+}
+
+/* Find the slot holding string s, or the empty slot where it would go */
+static size_t intern_slot(const queue_t *q, const char *s, uint64_t hash)
+{
+    size_t mask = ((size_t) 1 << q->intern_bits) - 1;
+    size_t i = hash & mask;
+    for (istr_t *is; (is = q->intern_table[i]); i = (i + 1) & mask) {
+        if (is->hash == hash && !strcmp(is->str, s))
+            break;
+    }
+    return i;
+}
+
+/*
+ * Double the number of slots of the intern table of q.
+ * Return false if could not allocate space.
+ */
+static bool intern_grow(queue_t *q)
+{
+    int bits = q->intern_table ? q->intern_bits + 1 : INTERN_MIN_BITS;
+    istr_t **table = malloc(sizeof(istr_t *) << bits);
+    if (!table)
+        return false;
+    memset(table, 0, sizeof(istr_t *) << bits);
+
+    size_t mask = ((size_t) 1 << bits) - 1;
+    for (size_t i = 0; q->intern_table && i < (size_t) 1 << q->intern_bits;
+         i++) {
+        istr_t *is = q->intern_table[i];
+        if (!is)
+            continue;
+        size_t j = is->hash & mask;
+        while (table[j])
+            j = (j + 1) & mask;
+        table[j] = is;
+    }
+
+    free(q->intern_table);
+    q->intern_table = table;
+    q->intern_bits = bits;
+    return true;
+}
+
+/*
+ * Get a shared copy of string s, whose length including the null
+ * terminator is len, adding one reference to it.
+ * Return NULL if could not allocate space.
+ */
+static char *intern_get(queue_t *q, const char *s, size_t len)
+{
+    /* Keep the table at most half full */
+    if ((!q->intern_table ||
+         (size_t) q->intern_count + 1 > (size_t) 1 << (q->intern_bits - 1)) &&
+        !intern_grow(q))
+        return NULL;
+
+    uint64_t hash = str_hash(s, len - 1);
+    size_t i = intern_slot(q, s, hash);
+    istr_t *is = q->intern_table[i];
+    if (!is) {
+        is = malloc(sizeof(istr_t) + len);
+        if (!is)
+            return NULL;
+        is->refcnt = 0;
+        is->hash = hash;
+        memcpy(is->str, s, len);
+        q->intern_table[i] = is;
+        q->intern_count++;
+    }
+    is->refcnt++;
+    return is->str;
+}
+
+/* Drop a reference to shared string s, freeing it with the last one */
+static void intern_put(queue_t *q, char *s)
+{
+    istr_t *is = (istr_t *) (s - offsetof(istr_t, str));
+    if (--is->refcnt)
+        return;
+
+    /* Remove it from the table, shifting back later entries as needed */
+    size_t mask = ((size_t) 1 << q->intern_bits) - 1;
+    size_t i = intern_slot(q, s, is->hash);
+    for (size_t j = (i + 1) & mask; q->intern_table[j]; j = (j + 1) & mask) {
+        size_t k = q->intern_table[j]->hash & mask;
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+            q->intern_table[i] = q->intern_table[j];
+            i = j;
+        }
+    }
+    q->intern_table[i] = NULL;
+    q->intern_count--;
+    free(is);
+}
+
 /*
  * Create empty queue.
  * Return NULL if could not allocate space.
@@ -12,19 +225,152 @@
 queue_t *q_new()
 {
     queue_t *q = malloc(sizeof(queue_t));
-    /* TODO: What if malloc returned NULL? */
-    q->head = NULL;
+    if (!q)
+        return NULL;
+
+    q->head = q->tail = NULL;
+    q->size = 0;
+    q->reversed = false;
+    q->spilled = 0;
+    q->slab_nodes = q_slab_nodes > 0 ? q_slab_nodes : 0;
+    q->slab_unused = 0;
+    q->slabs = NULL;
+    q->free_nodes = NULL;
+    q->free_count = 0;
+    q->intern = q_intern;
+    q->intern_bits = 0;
+    q->intern_count = 0;
+    q->intern_table = NULL;
+    /*
+     * Carve the first chunk right away, so that the first insertions do not
+     * pay for it.  On failure, the chunk is simply retried on insertion.
+     */
+    if (q->slab_nodes)
+        slab_grow(q, q->slab_nodes);
     return q;
 }
 
 /* Free all storage used by queue */
 void q_free(queue_t *q)
 {
-    /* TODO: How about freeing the list elements and the strings? */
-    /* Free queue structure */
+    if (!q)
+        return;
+
+    /*
+     * With slab elements and strings that are inline or interned, there is
+     * nothing to walk
+     */
+    if (q->slab_nodes <= 0 || (q->spilled && !q->intern)) {
+        list_ele_t *e = q->head;
+        while (e) {
+            list_ele_t *next = e->next;
+            if (!q_ele_inline(e) && !q->intern)
+                free(e->value);
+            if (q->slab_nodes <= 0)
+                free(e);
+            e = next;
+        }
+    }
+
+    /* Slab elements, live or recycled, go away along with their chunks */
+    slab_t *slab = q->slabs;
+    while (slab) {
+        slab_t *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    /* Interned strings go away along with the table */
+    for (size_t i = 0; q->intern_table && i < (size_t) 1 << q->intern_bits;
+         i++)
+        free(q->intern_table[i]);
+    free(q->intern_table);
+
     free(q);
 }
 
+/* Size of the sort key prefix cached in each list element */
+#define KEY_LEN sizeof(uint64_t)
+
+/* Compute the sort key prefix of string s, whose length is len */
+static inline uint64_t str_key(const char *s, size_t len)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i < KEY_LEN; i++)
+        key = key << 8 | (i < len ? tolower((unsigned char) s[i]) : 0);
+    return key;
+}
+
+/*
+ * Allocate a list element holding a copy of string s, whose length
+ * including the null terminator is len.
+ * Return NULL if could not allocate space.
+ */
+static list_ele_t *ele_new(queue_t *q, char *s, size_t len)
+{
+    list_ele_t *e = node_alloc(q);
+    if (!e)
+        return NULL;
+
+    e->len = len - 1;
+    e->key = str_key(s, e->len);
+    if (len <= Q_INLINE_LEN) {
+        e->value = memcpy(e->sbuf, s, len);
+        return e;
+    }
+
+    e->value = q->intern ? intern_get(q, s, len) : malloc(len);
+    if (!e->value) {
+        node_release(q, e);
+        return NULL;
+    }
+    if (!q->intern)
+        memcpy(e->value, s, len);
+    q->spilled++;
+    return e;
+}
+
+/* Release a list element along with its string */
+static void ele_free(queue_t *q, list_ele_t *e)
+{
+    if (!q_ele_inline(e)) {
+        if (q->intern)
+            intern_put(q, e->value);
+        else
+            free(e->value);
+        q->spilled--;
+    }
+    node_release(q, e);
+}
+
+/*
+ * Link the chain of elements first .. last, whose next and prev links are
+ * already set up, at the front or the back of the list of q.
+ */
+static void link_chain(queue_t *q,
+                       list_ele_t *first,
+                       list_ele_t *last,
+                       bool at_front)
+{
+    if (at_front) {
+        first->prev = NULL;
+        last->next = q->head;
+        if (q->head)
+            q->head->prev = last;
+        else
+            q->tail = last;
+        q->head = first;
+    } else {
+        last->next = NULL;
+        first->prev = q->tail;
+        if (q->tail)
+            q->tail->next = first;
+        else
+            q->head = first;
+        q->tail = last;
+    }
+}
+
 /*
  * Attempt to insert element at head of queue.
  * Return true if successful.
@@ -34,13 +380,15 @@ void q_free(queue_t *q)
  */
 bool q_insert_head(queue_t *q, char *s)
 {
-    list_ele_t *newh;
-    /* TODO: What should you do if the q is NULL? */
-    newh = malloc(sizeof(list_ele_t));
-    /* Don't forget to allocate space for the string and copy it */
-    /* What if either call to malloc returns NULL? */
-    newh->next = q->head;
-    q->head = newh;
+    if (!q)
+        return false;
+
+    list_ele_t *newh = ele_new(q, s, strlen(s) + 1);
+    if (!newh)
+        return false;
+
+    link_chain(q, newh, newh, !q->reversed);
+    q->size++;
     return true;
 }
 
@@ -53,10 +401,141 @@ bool q_insert_head(queue_t *q, char *s)
  */
 bool q_insert_tail(queue_t *q, char *s)
 {
-    /* TODO: You need to write the complete code for this function */
-    /* Remember: It should operate in O(1) time */
-    /* TODO: Remove the above comment when you are about to implement. */
-    return false;
+    if (!q)
+        return false;
+
+    list_ele_t *newt = ele_new(q, s, strlen(s) + 1);
+    if (!newt)
+        return false;
+
+    link_chain(q, newt, newt, q->reversed);
+    q->size++;
+    return true;
+}
+
+/*
+ * Insert n elements at head or tail of queue, holding copies of
+ * sv[0] .. sv[n-1], or n copies of s when sv is NULL.
+ * The new elements are chained up on their own first, and then spliced
+ * into the queue in O(1) time.
+ * Return false if q is NULL or could not allocate space, leaving q unchanged.
+ */
+static bool insert_n(queue_t *q, char *s, char **sv, int n, bool at_head)
+{
+    if (!q || n < 0 || !slab_reserve(q, n))
+        return false;
+    if (!n)
+        return true;
+
+    /* Which end of the list of q the elements go to */
+    bool at_front = at_head != q->reversed;
+    size_t len = sv ? 0 : strlen(s) + 1;
+    list_ele_t *first = NULL, *last = NULL;
+    for (int i = 0; i < n; i++) {
+        list_ele_t *e =
+            sv ? ele_new(q, sv[i], strlen(sv[i]) + 1) : ele_new(q, s, len);
+        if (!e) {
+            while (first) {
+                list_ele_t *next = first->next;
+                ele_free(q, first);
+                first = next;
+            }
+            return false;
+        }
+
+        if (at_front) {
+            /* Later strings go in front, as with repeated insertions */
+            e->next = first;
+            if (first)
+                first->prev = e;
+            else
+                last = e;
+            first = e;
+        } else {
+            e->prev = last;
+            e->next = NULL;
+            if (last)
+                last->next = e;
+            else
+                first = e;
+            last = e;
+        }
+    }
+
+    link_chain(q, first, last, at_front);
+    q->size += n;
+    return true;
+}
+
+/*
+ * Attempt to insert n copies of string s at head of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ */
+bool q_insert_head_n(queue_t *q, char *s, int n)
+{
+    return insert_n(q, s, NULL, n, true);
+}
+
+/*
+ * Attempt to insert n copies of string s at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ */
+bool q_insert_tail_n(queue_t *q, char *s, int n)
+{
+    return insert_n(q, s, NULL, n, false);
+}
+
+/*
+ * Attempt to insert strings sv[0] .. sv[n-1] at head of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ */
+bool q_insert_head_array(queue_t *q, char **sv, int n)
+{
+    return insert_n(q, NULL, sv, n, true);
+}
+
+/*
+ * Attempt to insert strings sv[0] .. sv[n-1] at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ */
+bool q_insert_tail_array(queue_t *q, char **sv, int n)
+{
+    return insert_n(q, NULL, sv, n, false);
+}
+
+/*
+ * Remove the element at the front or the back of the list of q, which
+ * must not be empty, copying its string to sp as q_remove_head does.
+ */
+static void remove_end(queue_t *q, bool at_front, char *sp, size_t bufsize)
+{
+    list_ele_t *e = at_front ? q->head : q->tail;
+    if (sp && bufsize) {
+        size_t n = e->len < bufsize - 1 ? e->len : bufsize - 1;
+        memcpy(sp, e->value, n);
+        sp[n] = '\0';
+    }
+
+    if (at_front) {
+        q->head = e->next;
+        if (q->head)
+            q->head->prev = NULL;
+        else
+            q->tail = NULL;
+    } else {
+        q->tail = e->prev;
+        if (q->tail)
+            q->tail->next = NULL;
+        else
+            q->head = NULL;
+    }
+    q->size--;
+
+    ele_free(q, e);
 }
 
 /*
@@ -69,9 +548,27 @@ bool q_insert_tail(queue_t *q, char *s)
  */
 bool q_remove_head(queue_t *q, char *sp, size_t bufsize)
 {
-    /* TODO: You need to fix up this code. */
-    /* TODO: Remove the above comment when you are about to implement. */
-    q->head = q->head->next;
+    if (!q || !q->head)
+        return false;
+
+    remove_end(q, !q->reversed, sp, bufsize);
+    return true;
+}
+
+/*
+ * Attempt to remove element from tail of queue.
+ * Return true if successful.
+ * Return false if queue is NULL or empty.
+ * If sp is non-NULL and an element is removed, copy the removed string to *sp
+ * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ * The space used by the list element and the string should be freed.
+ */
+bool q_remove_tail(queue_t *q, char *sp, size_t bufsize)
+{
+    if (!q || !q->head)
+        return false;
+
+    remove_end(q, q->reversed, sp, bufsize);
     return true;
 }
 
@@ -81,10 +578,7 @@ bool q_remove_head(queue_t *q, char *sp, size_t bufsize)
  */
 int q_size(queue_t *q)
 {
-    /* TODO: You need to write the code for this function */
-    /* Remember: It should operate in O(1) time */
-    /* TODO: Remove the above comment when you are about to implement. */
-    return 0;
+    return q ? q->size : 0;
 }
 
 /*
@@ -93,11 +587,270 @@ int q_size(queue_t *q)
  * This function should not allocate or free any list elements
  * (e.g., by calling q_insert_head, q_insert_tail, or q_remove_head).
  * It should rearrange the existing ones.
+ * The list itself is left alone: the queue just starts walking it from
+ * the other end.
  */
 void q_reverse(queue_t *q)
 {
-    /* TODO: You need to write the code for this function */
-    /* TODO: Remove the above comment when you are about to implement. */
+    if (!q || !q->head)
+        return;
+
+    q->reversed = !q->reversed;
+}
+
+/*
+ * Compare the strings of two elements, ignoring case.
+ * Most pairs differ in their cached key prefixes.  Otherwise, strings
+ * shorter than the prefix are equal, and longer ones are compared from the
+ * first character past the prefix.
+ */
+static inline int ele_cmp(const list_ele_t *a, const list_ele_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    if (a->len < KEY_LEN)
+        return 0;
+    return strcasecmp(a->value + KEY_LEN, b->value + KEY_LEN);
+}
+
+/*
+ * A run is a sorted, null-terminated list of elements.
+ * Sorting keeps a stack of pending runs, ordered as they appear in the queue.
+ */
+typedef struct {
+    list_ele_t *head, *tail;
+    size_t len;
+} run_t;
+
+/*
+ * Detach the run at the front of list, and return the remaining elements.
+ * A run is either non-descending, or strictly descending and then reversed
+ * in place.  Requiring descending runs to be strict keeps the sort stable.
+ */
+static list_ele_t *take_run(list_ele_t *list, run_t *run)
+{
+    list_ele_t *cur = list->next;
+    run->head = run->tail = list;
+    run->len = 1;
+
+    if (cur && ele_cmp(list, cur) > 0) {
+        list->next = NULL;
+        do {
+            list_ele_t *next = cur->next;
+            cur->next = run->head;
+            run->head = cur;
+            run->len++;
+            cur = next;
+        } while (cur && ele_cmp(run->head, cur) > 0);
+        return cur;
+    }
+
+    while (cur && ele_cmp(run->tail, cur) <= 0) {
+        run->tail = cur;
+        run->len++;
+        cur = cur->next;
+    }
+    run->tail->next = NULL;
+    return cur;
+}
+
+/*
+ * Merge run b into run a, which precedes it.  Equal elements of a stay in
+ * front of those of b.
+ */
+static void merge_runs(run_t *a, const run_t *b)
+{
+    a->len += b->len;
+
+    /* Runs that are already in order are just concatenated */
+    if (ele_cmp(a->tail, b->head) <= 0) {
+        a->tail->next = b->head;
+        a->tail = b->tail;
+        return;
+    }
+
+    list_ele_t *l = a->head, *r = b->head;
+    list_ele_t *head = NULL, **tail = &head;
+    while (l && r) {
+        if (ele_cmp(l, r) <= 0) {
+            *tail = l;
+            l = l->next;
+        } else {
+            *tail = r;
+            r = r->next;
+        }
+        tail = &(*tail)->next;
+    }
+    *tail = l ? l : r;
+    a->head = head;
+    /* Whichever run has elements left over provides the tail */
+    if (!l)
+        a->tail = b->tail;
+}
+
+/*
+ * Sort a null-terminated list of elements, and return it as a run.
+ *
+ * This is a bottom-up natural merge sort: the list is cut into its existing
+ * ascending or descending runs, which are merged pairwise without recursion
+ * or allocation.  A run is pushed onto the pending stack only while it is
+ * less than half as long as the run below it; otherwise the two are merged
+ * first.  Run lengths thus at least double down the stack, which keeps the
+ * merges balanced and the stack within 64 entries.  Input that is already
+ * (nearly) sorted, or sorted backwards, takes close to linear time.
+ */
+static run_t sort_list(list_ele_t *list)
+{
+    run_t pending[64];
+    int top = 0;
+
+    while (list) {
+        list = take_run(list, &pending[top++]);
+        while (top > 1 && pending[top - 2].len <= 2 * pending[top - 1].len) {
+            merge_runs(&pending[top - 2], &pending[top - 1]);
+            top--;
+        }
+    }
+
+    while (top > 1) {
+        merge_runs(&pending[top - 2], &pending[top - 1]);
+        top--;
+    }
+    return pending[0];
+}
+
+/*
+ * Work handed to a sort thread: either sort the list starting at
+ * run->head, or merge run other into run.
+ */
+typedef struct {
+    run_t *run;
+    const run_t *other;
+    pthread_t thread;
+    bool started;
+} sort_job_t;
+
+static void *sort_job(void *arg)
+{
+    sort_job_t *job = arg;
+    if (job->other)
+        merge_runs(job->run, job->other);
+    else
+        *job->run = sort_list(job->run->head);
+    return NULL;
+}
+
+/*
+ * Run jobs[0] .. jobs[n-1] concurrently, doing the first one in the calling
+ * thread, and wait for all of them.  A job whose thread cannot be created
+ * is done by the calling thread as well.
+ * Workers inherit the signal mask of the caller, which q_sort has set to
+ * block asynchronous signals, so they never take signals meant for the
+ * caller, e.g. SIGALRM used by qtest to time out operations.
+ */
+static void run_sort_jobs(sort_job_t *jobs, int n)
+{
+    for (int i = 1; i < n; i++)
+        jobs[i].started =
+            !pthread_create(&jobs[i].thread, NULL, sort_job, &jobs[i]);
+
+    sort_job(&jobs[0]);
+    for (int i = 1; i < n; i++) {
+        if (jobs[i].started)
+            pthread_join(jobs[i].thread, NULL);
+        else
+            sort_job(&jobs[i]);
+    }
+}
+
+/*
+ * Sort a list of size elements with nthreads threads.  The list is cut into
+ * nthreads consecutive parts that are sorted concurrently, and neighboring
+ * sorted parts are then merged pairwise, in parallel, until one is left.
+ * Merging neighbors only, with the left part first, keeps the sort stable.
+ * Must be called with asynchronous signals blocked, see q_sort.
+ */
+static run_t sort_list_parallel(list_ele_t *list, int size, int nthreads)
+{
+    run_t parts[MAX_SORT_THREADS];
+    sort_job_t jobs[MAX_SORT_THREADS];
+
+    int per_part = size / nthreads;
+    for (int i = 0; i < nthreads; i++) {
+        parts[i].head = list;
+        if (i < nthreads - 1) {
+            for (int n = 1; n < per_part; n++)
+                list = list->next;
+            list_ele_t *next = list->next;
+            list->next = NULL;
+            list = next;
+        }
+        jobs[i].run = &parts[i];
+        jobs[i].other = NULL;
+    }
+    run_sort_jobs(jobs, nthreads);
+
+    for (int nparts = nthreads; nparts > 1; nparts = (nparts + 1) / 2) {
+        int nmerges = nparts / 2;
+        for (int i = 0; i < nmerges; i++) {
+            jobs[i].run = &parts[2 * i];
+            jobs[i].other = &parts[2 * i + 1];
+        }
+        run_sort_jobs(jobs, nmerges);
+
+        for (int i = 1; i < nmerges; i++)
+            parts[i] = parts[2 * i];
+        if (nparts % 2)
+            parts[nmerges] = parts[nparts - 1];
+    }
+    return parts[0];
+}
+
+/*
+ * Sort a null-terminated list of len elements whose strings all agree,
+ * ignoring case, on their first depth characters.
+ *
+ * This is an MSD radix sort: elements are distributed into one bucket per
+ * case-folded character at position depth, preserving their order, and
+ * the buckets are concatenated in character order, which is the order
+ * strcasecmp gives.  Strings ending at depth land in bucket 0 and are equal
+ * to each other.  Other buckets are sorted recursively on the following
+ * position, or by merge sort once they are small or deep enough.
+ */
+static run_t radix_sort(list_ele_t *list, size_t len, size_t depth)
+{
+    list_ele_t *heads[256], *tails[256];
+    size_t counts[256] = {0};
+
+    if (len < RADIX_MIN_BUCKET || depth >= RADIX_MAX_DEPTH)
+        return sort_list(list);
+
+    for (list_ele_t *e = list; e; e = e->next) {
+        int c = depth < KEY_LEN
+                    ? (int) (e->key >> (8 * (KEY_LEN - 1 - depth))) & 0xff
+                    : tolower((unsigned char) e->value[depth]);
+        if (counts[c]++)
+            tails[c]->next = e;
+        else
+            heads[c] = e;
+        tails[c] = e;
+    }
+
+    run_t sorted = {NULL, NULL, len};
+    list_ele_t **link = &sorted.head;
+    for (int c = 0; c < 256; c++) {
+        if (!counts[c])
+            continue;
+        tails[c]->next = NULL;
+
+        run_t bucket = {heads[c], tails[c], counts[c]};
+        if (c && counts[c] > 1)
+            bucket = radix_sort(heads[c], counts[c], depth + 1);
+        *link = bucket.head;
+        link = &bucket.tail->next;
+        sorted.tail = bucket.tail;
+    }
+    return sorted;
 }
 
 /*
@@ -107,6 +860,67 @@ void q_reverse(queue_t *q)
  */
 void q_sort(queue_t *q)
 {
-    /* TODO: You need to write the code for this function */
-    /* TODO: Remove the above comment when you are about to implement. */
+    if (!q || q->size < 2)
+        return;
+
+    int nthreads = q_sort_threads;
+    if (nthreads > MAX_SORT_THREADS)
+        nthreads = MAX_SORT_THREADS;
+    if (nthreads > q->size / SORT_MIN_PER_THREAD)
+        nthreads = q->size / SORT_MIN_PER_THREAD;
+
+    /*
+     * The sorts below follow next links, so they must walk the list in
+     * queue order to stay stable.  Turn a reversed list around first.
+     */
+    if (q->reversed) {
+        for (list_ele_t *e = q->head; e; e = e->prev) {
+            list_ele_t *next = e->next;
+            e->next = e->prev;
+            e->prev = next;
+        }
+        list_ele_t *head = q->head;
+        q->head = q->tail;
+        q->tail = head;
+        q->reversed = false;
+    }
+
+    /*
+     * Sort threads relink the list and share job state in the stack frame
+     * of sort_list_parallel, so the caller must not leave q_sort before
+     * they are joined and the list is whole again, as it would if qtest's
+     * time limit handler jumped out of it.  Hold off asynchronous signals
+     * until then; one that arrives in the meantime is delivered when they
+     * are unblocked.  Faults cannot be put off, so they stay unblocked.
+     */
+    bool parallel = q_sort_algorithm != Q_SORT_RADIX && nthreads > 1;
+    sigset_t block, saved;
+    if (parallel) {
+        sigfillset(&block);
+        sigdelset(&block, SIGSEGV);
+        sigdelset(&block, SIGBUS);
+        sigdelset(&block, SIGFPE);
+        sigdelset(&block, SIGILL);
+        pthread_sigmask(SIG_BLOCK, &block, &saved);
+    }
+
+    run_t sorted;
+    if (q_sort_algorithm == Q_SORT_RADIX)
+        sorted = radix_sort(q->head, q->size, 0);
+    else if (parallel)
+        sorted = sort_list_parallel(q->head, q->size, nthreads);
+    else
+        sorted = sort_list(q->head);
+    q->head = sorted.head;
+    q->tail = sorted.tail;
+
+    /* Sorting only maintains next links; restore the prev links */
+    list_ele_t *prev = NULL;
+    for (list_ele_t *e = q->head; e; e = e->next) {
+        e->prev = prev;
+        prev = e;
+    }
+
+    if (parallel)
+        pthread_sigmask(SIG_SETMASK, &saved, NULL);
 }
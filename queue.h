@@ -5,32 +5,135 @@
  * This program implements a queue supporting both FIFO and LIFO
  * operations.
  *
- * It uses a singly-linked list to represent the set of queue elements
+ * It uses a doubly-linked list to represent the set of queue elements,
+ * so that elements can be removed from either end in O(1) time, and the
+ * queue can be reversed in O(1) time by flipping its direction.
  */
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Data structure declarations */
 
-/* Linked list element (You shouldn't need to change this) */
+/*
+ * Strings shorter than this many bytes (including the null terminator) are
+ * stored inside the list element itself.
+ */
+#define Q_INLINE_LEN 16
+
+/* Linked list element */
 typedef struct ELE {
     /* Pointer to array holding string.
-     * This array needs to be explicitly allocated and freed
+     * Short strings are kept in sbuf, and value then points at it.
+     * Longer ones spill into an array that needs to be explicitly allocated
+     * and freed
      */
     char *value;
-    struct ELE *next;
+    struct ELE *next, *prev;
+    /*
+     * Sort key prefix: the first 8 characters of the string, case-folded
+     * and packed big-endian, padded with zero bytes.  Comparing keys as
+     * integers orders strings like strcasecmp does on those characters.
+     */
+    uint64_t key;
+    size_t len; /* Length of the string */
+    char sbuf[Q_INLINE_LEN];
 } list_ele_t;
 
+/* Is the string of element e stored inside the element? */
+static inline bool q_ele_inline(const list_ele_t *e)
+{
+    return e->value == e->sbuf;
+}
+
+/* Chunk of list elements handed out by the node slab allocator */
+typedef struct SLAB {
+    struct SLAB *next;
+    int nr; /* Number of elements in this chunk */
+    list_ele_t nodes[];
+} slab_t;
+
+/* Shared copy of a string, for queues that intern their strings */
+typedef struct {
+    size_t refcnt; /* Number of elements pointing at str */
+    uint64_t hash; /* Hash value of str */
+    char str[];
+} istr_t;
+
 /* Queue structure */
 typedef struct {
     list_ele_t *head; /* Linked list of elements */
-    /* TODO: You will need to add more fields to this structure
-     *        to efficiently implement q_size and q_insert_tail.
+    list_ele_t *tail; /* Last element, so that q_insert_tail is O(1) */
+    int size;         /* Number of elements, so that q_size is O(1) */
+    /*
+     * Direction of the queue.  When reversed is set, the queue starts at
+     * tail and runs through the prev links back to head.
+     */
+    bool reversed;
+    int spilled; /* Number of elements whose string is not inline */
+    /*
+     * Node slab allocator.  When slab_nodes > 0, list elements are carved
+     * from chunks of (at least) slab_nodes elements, and elements released
+     * by q_remove_head are kept on free_nodes for reuse.
+     */
+    int slab_nodes;
+    int slab_unused;        /* Elements not yet carved from newest chunk */
+    slab_t *slabs;          /* All chunks owned by the queue, newest first */
+    list_ele_t *free_nodes; /* Recycled list elements */
+    int free_count;         /* Number of elements on free_nodes */
+    /*
+     * String interning.  When intern is set, strings too long to be stored
+     * inline are shared between elements through a hash table of
+     * reference-counted copies, with 2^intern_bits slots.
      */
-    /* TODO: Remove the above comment when you are about to implement. */
+    bool intern;
+    int intern_bits;
+    int intern_count; /* Number of distinct strings in the table */
+    istr_t **intern_table;
 } queue_t;
 
+/* Element at head of queue, or NULL if q is empty */
+static inline list_ele_t *q_first(const queue_t *q)
+{
+    return q->reversed ? q->tail : q->head;
+}
+
+/* Element at tail of queue, or NULL if q is empty */
+static inline list_ele_t *q_last(const queue_t *q)
+{
+    return q->reversed ? q->head : q->tail;
+}
+
+/* Element following e when walking q from head to tail */
+static inline list_ele_t *q_next(const queue_t *q, const list_ele_t *e)
+{
+    return q->reversed ? e->prev : e->next;
+}
+
+/*
+ * Number of list elements per slab chunk for queues created by q_new.
+ * Set to 0, the default, to allocate every list element separately.
+ */
+extern int q_slab_nodes;
+
+/*
+ * Whether queues created by q_new intern their strings, so that elements
+ * holding equal long strings share one copy.
+ */
+extern int q_intern;
+
+/*
+ * Number of threads q_sort may use.  Queues large enough are split into
+ * that many parts, which are sorted and then merged concurrently.
+ */
+extern int q_sort_threads;
+
+/* Algorithms q_sort can use, selected by q_sort_algorithm */
+#define Q_SORT_MERGE 0 /* Natural merge sort, possibly multi-threaded */
+#define Q_SORT_RADIX 1 /* Case-folded MSD radix sort */
+extern int q_sort_algorithm;
+
 /* Operations on queue */
 
 /*
@@ -63,6 +166,36 @@ bool q_insert_head(queue_t *q, char *s);
  */
 bool q_insert_tail(queue_t *q, char *s);
 
+/*
+ * Attempt to insert n copies of string s at head of queue, with the same
+ * result as calling q_insert_head n times.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space, in which case
+ * the queue is left unchanged.
+ * Storage for all the elements is set aside at once, and the new elements
+ * are linked into the queue in a single step.
+ */
+bool q_insert_head_n(queue_t *q, char *s, int n);
+
+/*
+ * Attempt to insert n copies of string s at tail of queue.
+ * Same contract as q_insert_head_n.
+ */
+bool q_insert_tail_n(queue_t *q, char *s, int n);
+
+/*
+ * Attempt to insert strings sv[0] .. sv[n-1] at head of queue, with the same
+ * result as calling q_insert_head on each of them in turn.
+ * Same contract as q_insert_head_n.
+ */
+bool q_insert_head_array(queue_t *q, char **sv, int n);
+
+/*
+ * Attempt to insert strings sv[0] .. sv[n-1] at tail of queue, in order.
+ * Same contract as q_insert_head_n.
+ */
+bool q_insert_tail_array(queue_t *q, char **sv, int n);
+
 /*
  * Attempt to remove element from head of queue.
  * Return true if successful.
@@ -73,6 +206,12 @@ bool q_insert_tail(queue_t *q, char *s);
  */
 bool q_remove_head(queue_t *q, char *sp, size_t bufsize);
 
+/*
+ * Attempt to remove element from tail of queue.
+ * Same contract as q_remove_head.
+ */
+bool q_remove_tail(queue_t *q, char *sp, size_t bufsize);
+
 /*
  * Return number of elements in queue.
  * Return 0 if q is NULL or empty
@@ -85,6 +224,7 @@ int q_size(queue_t *q);
  * This function should not allocate or free any list elements
  * (e.g., by calling q_insert_head, q_insert_tail, or q_remove_head).
  * It should rearrange the existing ones.
+ * The queue is reversed in O(1) time by flipping its direction.
  */
 void q_reverse(queue_t *q);
 
@@ -2,10 +2,30 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 
+/*
+ * Random bytes come from a ChaCha20 keystream kept in a userspace buffer,
+ * so that most requests do not need a system call.  The key is taken from
+ * /dev/urandom, and replaced with fresh kernel randomness after every
+ * RESEED_BYTES bytes of output.
+ */
+#define CHACHA_BLOCK 64
+#define BUFFER_BLOCKS 16
+#define RESEED_BYTES (1 << 20)
+
+static uint32_t state[16];
+static uint8_t buffer[BUFFER_BLOCKS * CHACHA_BLOCK];
+static size_t buffer_pos = sizeof(buffer);
+static size_t since_reseed = RESEED_BYTES;
+
+/* Unused bits of the last byte drawn by randombit */
+static uint8_t bit_pool;
+static int bit_count = 0;
+
 /* shameless stolen from ebacs */
-void randombytes(uint8_t *x, size_t how_much)
+static void kernel_randombytes(uint8_t *x, size_t how_much)
 {
     ssize_t i;
     static int fd = -1;
@@ -38,9 +58,113 @@ void randombytes(uint8_t *x, size_t how_much)
     }
 }
 
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d) \
+    do {                         \
+        a += b;                  \
+        d = ROTL32(d ^ a, 16);   \
+        c += d;                  \
+        b = ROTL32(b ^ c, 12);   \
+        a += b;                  \
+        d = ROTL32(d ^ a, 8);    \
+        c += d;                  \
+        b = ROTL32(b ^ c, 7);    \
+    } while (0)
+
+/* Write the next keystream block to out and advance the block counter */
+static void chacha20_block(uint8_t *out)
+{
+    uint32_t x[16];
+    memcpy(x, state, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        QUARTERROUND(x[0], x[4], x[8], x[12]);
+        QUARTERROUND(x[1], x[5], x[9], x[13]);
+        QUARTERROUND(x[2], x[6], x[10], x[14]);
+        QUARTERROUND(x[3], x[7], x[11], x[15]);
+        QUARTERROUND(x[0], x[5], x[10], x[15]);
+        QUARTERROUND(x[1], x[6], x[11], x[12]);
+        QUARTERROUND(x[2], x[7], x[8], x[13]);
+        QUARTERROUND(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++) {
+        uint32_t v = x[i] + state[i];
+        out[4 * i] = (uint8_t) v;
+        out[4 * i + 1] = (uint8_t) (v >> 8);
+        out[4 * i + 2] = (uint8_t) (v >> 16);
+        out[4 * i + 3] = (uint8_t) (v >> 24);
+    }
+
+    /* 64-bit block counter in words 12 and 13 */
+    if (!++state[12])
+        state[13]++;
+}
+
+/* Key the generator with kernel randomness */
+static void reseed(void)
+{
+    /* "expand 32-byte k" */
+    state[0] = 0x61707865;
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    kernel_randombytes((uint8_t *) &state[4], 8 * sizeof(uint32_t));
+    state[12] = state[13] = 0;
+    kernel_randombytes((uint8_t *) &state[14], 2 * sizeof(uint32_t));
+    since_reseed = 0;
+}
+
+static void refill(void)
+{
+    if (since_reseed >= RESEED_BYTES)
+        reseed();
+    for (int i = 0; i < BUFFER_BLOCKS; i++)
+        chacha20_block(buffer + i * CHACHA_BLOCK);
+    buffer_pos = 0;
+    since_reseed += sizeof(buffer);
+}
+
+void randombytes(uint8_t *x, size_t how_much)
+{
+    while (how_much > 0) {
+        if (buffer_pos == sizeof(buffer))
+            refill();
+
+        size_t n = sizeof(buffer) - buffer_pos;
+        if (n > how_much)
+            n = how_much;
+        memcpy(x, buffer + buffer_pos, n);
+        /* Never hand out the same keystream twice */
+        memset(buffer + buffer_pos, 0, n);
+        buffer_pos += n;
+        x += n;
+        how_much -= n;
+    }
+}
+
 uint8_t randombit(void)
 {
-    uint8_t ret = 0;
-    randombytes(&ret, 1);
-    return (ret & 1);
+    if (!bit_count) {
+        randombytes(&bit_pool, 1);
+        bit_count = 8;
+    }
+    uint8_t ret = bit_pool & 1;
+    bit_pool >>= 1;
+    bit_count--;
+    return ret;
+}
+
+void randombits(uint8_t *x, size_t how_much)
+{
+    uint8_t bytes[64];
+    while (how_much > 0) {
+        size_t n = (how_much + 7) / 8;
+        if (n > sizeof(bytes))
+            n = sizeof(bytes);
+        randombytes(bytes, n);
+        for (size_t i = 0; i < n && how_much > 0; i++) {
+            for (int b = 0; b < 8 && how_much > 0; b++, how_much--)
+                *x++ = (bytes[i] >> b) & 1;
+        }
+    }
 }
@@ -6,4 +6,7 @@
 void randombytes(uint8_t *x, size_t xlen);
 uint8_t randombit(void);
 
+/* Fill x with how_much random bits, one per byte, each 0 or 1 */
+void randombits(uint8_t *x, size_t how_much);
+
 #endif
@@ -287,3 +287,32 @@ double delta_time(double *timep)
     *timep = current_time;
     return delta;
 }
+
+uint64_t time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_sample(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+void sort_samples(uint64_t *samples, size_t n)
+{
+    qsort(samples, n, sizeof(uint64_t), cmp_sample);
+}
+
+/* Nearest-rank percentile */
+uint64_t sample_percentile(const uint64_t *sorted, size_t n, double p)
+{
+    if (!n)
+        return 0;
+    size_t rank = (size_t) (p * n);
+    if (rank < p * n)
+        rank++;
+    return sorted[rank ? rank - 1 : 0];
+}
@@ -3,6 +3,8 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* Default reporting level.  Must recompile when change */
 #ifndef RPT
@@ -58,4 +60,13 @@ void init_time(double *timep);
    and reset timer */
 double delta_time(double *timep);
 
+/* Current time of the monotonic clock in nanoseconds */
+uint64_t time_ns();
+
+/* Sort samples of a measurement in ascending order */
+void sort_samples(uint64_t *samples, size_t n);
+
+/* Value below which a fraction p of n sorted samples fall */
+uint64_t sample_percentile(const uint64_t *sorted, size_t n, double p);
+
 #endif /* LAB0_REPORT_H */
@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+
+# Generate synthetic qtest traces from a workload description
+
+import argparse
+import bisect
+import math
+import random
+import sys
+
+OPS = ["ih", "it", "rh", "rt", "rhq", "size", "reverse", "sort"]
+INSERTS = ("ih", "it")
+REMOVES = ("rh", "rt", "rhq")
+LETTERS = "abcdefghijklmnopqrstuvwxyz"
+
+
+def parse_mix(text):
+    """Parse 'ih=40,it=30,rh=30' into a list of (op, weight)"""
+    mix = []
+    for item in text.split(","):
+        op, _, weight = item.partition("=")
+        if op not in OPS:
+            raise argparse.ArgumentTypeError(f"unknown operation '{op}'")
+        mix.append((op, float(weight) if weight else 1.0))
+    if sum(w for _, w in mix) <= 0:
+        raise argparse.ArgumentTypeError("operation mix adds up to zero")
+    return mix
+
+
+def parse_range(text):
+    """Parse 'min:max' queue size bounds"""
+    low, _, high = text.partition(":")
+    low, high = int(low), int(high) if high else int(low)
+    if low < 0 or high < low:
+        raise argparse.ArgumentTypeError(f"bad size range '{text}'")
+    return low, high
+
+
+def parse_dist(text, kinds):
+    """Parse 'kind:arg:arg' into (kind, [args])"""
+    kind, *args = text.split(":")
+    if kind not in kinds:
+        raise argparse.ArgumentTypeError(
+            f"unknown distribution '{kind}', expected one of "
+            + ", ".join(kinds))
+    return kind, [float(a) for a in args]
+
+
+class Keys:
+    """Chooses the key of each insertion and turns it into a string"""
+
+    def __init__(self, args, rng):
+        self.rng = rng
+        self.kind, params = args.keys
+        self.length_kind, self.length_args = args.length
+        self.seed = args.seed
+        self.next = 0
+        self.strings = {}
+
+        if self.kind == "dup":
+            self.universe = int(params[0]) if params else 4
+        elif self.kind in ("sorted", "reverse"):
+            # Every insertion gets a new key
+            self.universe = args.ops + args.prefill
+        else:
+            self.universe = args.universe
+        self.universe = max(self.universe, 1)
+        # Keys start with their index in base 26, so their order is that of
+        # the indexes
+        self.width = 1
+        while 26 ** self.width < self.universe:
+            self.width += 1
+
+        if self.kind == "zipf":
+            s = params[0] if params else 1.0
+            total = 0.0
+            self.cdf = []
+            for rank in range(self.universe):
+                total += 1.0 / (rank + 1) ** s
+                self.cdf.append(total)
+            # Popular keys are spread over the key space
+            self.ranks = list(range(self.universe))
+            rng.shuffle(self.ranks)
+
+    def index(self):
+        if self.kind == "zipf":
+            x = self.rng.random() * self.cdf[-1]
+            rank = bisect.bisect_left(self.cdf, x)
+            return self.ranks[min(rank, self.universe - 1)]
+        if self.kind == "sorted":
+            self.next += 1
+            return self.next - 1
+        if self.kind == "reverse":
+            self.next += 1
+            return self.universe - self.next
+        return self.rng.randrange(self.universe)
+
+    def length(self, rng):
+        args = self.length_args
+        if self.length_kind == "fixed":
+            n = args[0] if args else 8
+        elif self.length_kind == "uniform":
+            low = args[0] if args else 5
+            n = rng.uniform(low, args[1] if len(args) > 1 else low + 10)
+        else:
+            mu = args[0] if args else math.log(8)
+            n = rng.lognormvariate(mu, args[1] if len(args) > 1 else 0.5)
+        return max(int(round(n)), self.width)
+
+    def string(self, i):
+        s = self.strings.get(i)
+        if s is None:
+            digits = []
+            for _ in range(self.width):
+                digits.append(LETTERS[i % 26])
+                i //= 26
+            key = "".join(reversed(digits))
+            # The rest of the string only depends on the key
+            rng = random.Random(f"{self.seed}:{key}")
+            n = self.length(rng)
+            s = key + "".join(rng.choice(LETTERS) for _ in range(n - len(key)))
+            if self.kind not in ("sorted", "reverse"):
+                self.strings[i] = s
+        return s
+
+    def choose(self):
+        return self.string(self.index())
+
+
+class Writer:
+    """Writes commands, merging runs of identical ones into one"""
+
+    def __init__(self, out):
+        self.out = out
+        self.last = None
+        self.count = 0
+
+    def emit(self, cmd):
+        if cmd == self.last and cmd[0] in INSERTS + ("size",):
+            self.count += 1
+            return
+        self.flush()
+        self.last = cmd
+        self.count = 1
+
+    def flush(self):
+        if not self.last:
+            return
+        op, *args = self.last
+        if self.count > 1:
+            args.append(str(self.count))
+        self.out.write(" ".join([op] + args) + "\n")
+        self.last = None
+
+
+def generate(args, out):
+    rng = random.Random(args.seed)
+    keys = Keys(args, rng)
+    low, high = args.size
+    ops = [op for op, _ in args.mix]
+    weights = [w for _, w in args.mix]
+
+    out.write(f"# Synthetic workload: {' '.join(sys.argv[1:])}\n")
+    out.write("option fail 0\noption malloc 0\nnew\n")
+    w = Writer(out)
+    size = 0
+    for _ in range(args.prefill):
+        w.emit(("it", keys.choose()))
+        size += 1
+    for _ in range(args.ops):
+        op = rng.choices(ops, weights)[0]
+        # Keep the queue within its size bounds
+        if op in REMOVES and size <= low:
+            op = rng.choice(INSERTS)
+        elif op in INSERTS and size >= high:
+            op = rng.choice(REMOVES[:2])
+        if op in INSERTS:
+            w.emit((op, keys.choose()))
+            size += 1
+        elif op in REMOVES:
+            if size == 0:
+                continue
+            w.emit((op,))
+            size -= 1
+        else:
+            w.emit((op,))
+    w.flush()
+    out.write("free\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate a qtest trace from a workload description")
+    parser.add_argument("-o", "--output", help="Output file (default: stdout)")
+    parser.add_argument("-n", "--ops", type=int, default=100000,
+                        help="Number of operations (default: 100000)")
+    parser.add_argument("-m", "--mix", type=parse_mix,
+                        default=parse_mix("ih=25,it=25,rh=25,rt=25"),
+                        help="Operation weights, e.g. ih=40,it=30,rh=20,"
+                        "size=5,sort=5 (operations: " + ", ".join(OPS) + ")")
+    parser.add_argument("-s", "--size", type=parse_range, default=(0, 10000),
+                        help="Queue size bounds min:max (default: 0:10000)")
+    parser.add_argument("-p", "--prefill", type=int, default=0,
+                        help="Elements inserted at tail before the mix")
+    parser.add_argument("-l", "--length",
+                        type=lambda t: parse_dist(
+                            t, ["fixed", "uniform", "lognormal"]),
+                        default=("uniform", [5, 15]),
+                        help="String lengths: fixed:N, uniform:MIN:MAX or "
+                        "lognormal:MU:SIGMA (default: uniform:5:15)")
+    parser.add_argument("-k", "--keys",
+                        type=lambda t: parse_dist(
+                            t, ["uniform", "zipf", "sorted", "reverse",
+                                "dup"]),
+                        default=("uniform", []),
+                        help="Key popularity: uniform, zipf:S, sorted, "
+                        "reverse or dup:K for K distinct keys "
+                        "(default: uniform)")
+    parser.add_argument("-u", "--universe", type=int, default=100000,
+                        help="Distinct keys for uniform and zipf "
+                        "(default: 100000)")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="Random seed (default: 1)")
+    args = parser.parse_args()
+
+    if args.output:
+        with open(args.output, "w") as out:
+            generate(args, out)
+    else:
+        generate(args, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,280 @@
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bqueue.h"
+#include "cqueue.h"
+#include "report.h"
+#include "stress.h"
+
+/* The test needs to use regular malloc/free */
+#define INTERNAL 1
+#include "harness.h"
+
+#define STRESS_BUFSIZE 32
+
+/* How long a blocking queue consumer waits before checking for the end */
+#define STRESS_WAIT_MS 10
+
+const char *stress_queue_names[STRESS_NQUEUES] = {"lockfree", "blocking"};
+
+/* Test being run */
+static struct {
+    stress_run_t *run;
+    void *q;
+    atomic_int producers_left;
+    atomic_bool stop;    /* Should the threads give up? */
+    atomic_uchar **seen; /* How many times was each string removed? */
+    atomic_bool bad;     /* Was an unexpected string removed? */
+} stress;
+
+static void *stress_new()
+{
+    if (stress.run->queue == STRESS_BLOCKING)
+        return bq_new();
+    return cq_new();
+}
+
+static void stress_free()
+{
+    if (stress.run->queue == STRESS_BLOCKING)
+        bq_free(stress.q);
+    else
+        cq_free(stress.q);
+}
+
+static bool stress_insert(char *s)
+{
+    if (stress.run->queue == STRESS_BLOCKING)
+        return bq_insert_tail(stress.q, s);
+    return cq_insert_tail(stress.q, s);
+}
+
+/* Remove a string.  If wait is set, wait a little while the queue is empty */
+static bool stress_remove(char *sp, bool wait)
+{
+    if (stress.run->queue == STRESS_BLOCKING)
+        return bq_remove_head_wait(stress.q, sp, STRESS_BUFSIZE,
+                                   wait ? STRESS_WAIT_MS : 0);
+    if (cq_remove_head(stress.q, sp, STRESS_BUFSIZE))
+        return true;
+    if (wait)
+        sched_yield();
+    return false;
+}
+
+/* Check off a removed string */
+static void stress_seen(char *s)
+{
+    int id;
+    long i;
+    if (sscanf(s, "%d:%ld", &id, &i) != 2 || id < 0 ||
+        id >= stress.run->producers || i < 0 || i >= stress.run->ops) {
+        report(1, "ERROR: Removed unexpected string '%s'", s);
+        atomic_store(&stress.bad, true);
+        return;
+    }
+    atomic_fetch_add(&stress.seen[id][i], 1);
+}
+
+static void stress_record(stress_thread_t *t, uint64_t ns)
+{
+    if (t->nlat == t->lat_size) {
+        size_t size = t->lat_size ? 2 * t->lat_size : 1024;
+        uint64_t *lat = realloc(t->lat, size * sizeof(uint64_t));
+        if (!lat)
+            return;
+        t->lat = lat;
+        t->lat_size = size;
+    }
+    t->lat[t->nlat++] = ns;
+}
+
+static void *stress_producer(void *arg)
+{
+    stress_thread_t *t = arg;
+    bool latency = stress.run->latency;
+    int mix = stress.run->mix;
+    unsigned int seed = t->id + 1;
+    char buf[STRESS_BUFSIZE];
+    uint64_t start = time_ns();
+
+    for (t->ops = 0; t->ops < stress.run->ops && !atomic_load(&stress.stop);
+         t->ops++) {
+        bool insert = mix >= 100 || (int) (rand_r(&seed) % 100) < mix;
+        if (insert)
+            snprintf(buf, STRESS_BUFSIZE, "%d:%ld", t->id, t->inserts);
+        uint64_t t0 = latency ? time_ns() : 0;
+        bool ok = insert ? stress_insert(buf) : stress_remove(buf, false);
+        if (latency)
+            stress_record(t, time_ns() - t0);
+        if (ok && insert)
+            t->inserts++;
+        else if (ok)
+            stress_seen(buf);
+    }
+
+    t->elapsed = (time_ns() - start) * 1e-9;
+    atomic_fetch_sub(&stress.producers_left, 1);
+    return NULL;
+}
+
+static void *stress_consumer(void *arg)
+{
+    stress_thread_t *t = arg;
+    bool latency = stress.run->latency;
+    char buf[STRESS_BUFSIZE];
+    uint64_t start = time_ns();
+
+    while (!atomic_load(&stress.stop)) {
+        bool done = !atomic_load(&stress.producers_left);
+        uint64_t t0 = latency ? time_ns() : 0;
+        if (stress_remove(buf, true)) {
+            if (latency)
+                stress_record(t, time_ns() - t0);
+            stress_seen(buf);
+            t->ops++;
+        } else if (done) {
+            break;
+        }
+    }
+
+    t->elapsed = (time_ns() - start) * 1e-9;
+    return NULL;
+}
+
+/* Allocate the seen counters.  Return false if there is not enough memory */
+static bool stress_alloc_seen()
+{
+    int producers = stress.run->producers;
+    stress.seen = calloc(producers, sizeof(atomic_uchar *));
+    if (!stress.seen)
+        return false;
+    for (int p = 0; p < producers; p++) {
+        stress.seen[p] = calloc(stress.run->ops, sizeof(atomic_uchar));
+        if (!stress.seen[p])
+            return false;
+    }
+    return true;
+}
+
+static void stress_free_seen()
+{
+    for (int p = 0; stress.seen && p < stress.run->producers; p++)
+        free(stress.seen[p]);
+    free(stress.seen);
+    stress.seen = NULL;
+}
+
+/* Start the threads, and wait for those that started to finish */
+static bool stress_threads(stress_run_t *run)
+{
+    bool ok = true;
+    int nthreads = run->producers + run->consumers;
+    uint64_t start = time_ns();
+    for (int i = 0; i < nthreads; i++) {
+        stress_thread_t *t = &run->threads[i];
+        t->producer = i < run->producers;
+        t->id = t->producer ? i : i - run->producers;
+        t->started = !pthread_create(
+            &t->tid, NULL, t->producer ? stress_producer : stress_consumer, t);
+        if (!t->started) {
+            /* Let the threads that did start give up */
+            atomic_store(&stress.stop, true);
+            if (t->producer)
+                atomic_fetch_sub(&stress.producers_left, 1);
+            ok = false;
+        }
+    }
+    for (int i = 0; i < nthreads; i++) {
+        if (run->threads[i].started)
+            pthread_join(run->threads[i].tid, NULL);
+    }
+    run->elapsed = (time_ns() - start) * 1e-9;
+
+    if (!ok)
+        report(1, "ERROR: Could not start stress test threads");
+    return ok;
+}
+
+/* Check that every inserted string was removed once */
+static bool stress_check(stress_run_t *run)
+{
+    long lost = 0, duplicated = 0;
+    for (int p = 0; p < run->producers; p++) {
+        for (long i = 0; i < run->ops; i++) {
+            int expect = i < run->threads[p].inserts;
+            int seen = stress.seen[p][i];
+            if (seen < expect)
+                lost++;
+            else if (seen > expect)
+                duplicated++;
+        }
+    }
+    if (lost || duplicated) {
+        report(1, "ERROR: %ld elements lost, %ld removed more than once", lost,
+               duplicated);
+        return false;
+    }
+    return !atomic_load(&stress.bad);
+}
+
+bool stress_run(stress_run_t *run)
+{
+    size_t baseline = allocation_check();
+    stress.run = run;
+    run->leftover = 0;
+    run->elapsed = 0;
+    run->threads = calloc(run->producers + run->consumers,
+                          sizeof(stress_thread_t));
+    if (!run->threads || !stress_alloc_seen()) {
+        report(1, "ERROR: Could not allocate space for stress test results");
+        stress_free_seen();
+        stress_done(run);
+        return false;
+    }
+    stress.q = stress_new();
+    if (!stress.q) {
+        report(1, "ERROR: Could not allocate concurrent queue");
+        stress_free_seen();
+        stress_done(run);
+        return false;
+    }
+    atomic_store(&stress.producers_left, run->producers);
+    atomic_store(&stress.stop, false);
+    atomic_store(&stress.bad, false);
+
+    bool ok = stress_threads(run);
+
+    /* Whatever the threads left behind must be checked off as well */
+    char buf[STRESS_BUFSIZE];
+    while (stress_remove(buf, false)) {
+        stress_seen(buf);
+        run->leftover++;
+    }
+
+    /* Strings are only all accounted for when every thread ran to the end */
+    ok = ok && stress_check(run);
+    stress_free_seen();
+
+    stress_free();
+    stress.q = NULL;
+    if (allocation_check() != baseline) {
+        report(1,
+               "ERROR: Freed concurrent queue, but %lu blocks are still "
+               "allocated",
+               (unsigned long) (allocation_check() - baseline));
+        ok = false;
+    }
+
+    return ok;
+}
+
+void stress_done(stress_run_t *run)
+{
+    for (int i = 0; run->threads && i < run->producers + run->consumers; i++)
+        free(run->threads[i].lat);
+    free(run->threads);
+    run->threads = NULL;
+}
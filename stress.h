@@ -0,0 +1,72 @@
+#ifndef LAB0_STRESS_H
+#define LAB0_STRESS_H
+
+/*
+ * Concurrent stress test of the lock-free and blocking queues, shared by the
+ * stress command of qtest and by cqtest.
+ *
+ * Producers perform a fixed number of operations, each an insert with
+ * probability mix percent and a remove otherwise.  Consumers only remove,
+ * until every producer is done and the queue is empty.  Each inserted string
+ * encodes its producer and sequence number, so that every removal can be
+ * checked off.  Whatever the threads leave in the queue is removed and
+ * checked off at the end.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Queues that can be stress tested */
+typedef enum {
+    STRESS_LOCKFREE,
+    STRESS_BLOCKING,
+    STRESS_NQUEUES
+} stress_queue_t;
+
+/* Names of the queues, indexed by stress_queue_t */
+extern const char *stress_queue_names[STRESS_NQUEUES];
+
+/* Results of one thread */
+typedef struct {
+    int id; /* Number among producers, or among consumers */
+    bool producer;
+    long ops;      /* Operations performed */
+    long inserts;  /* Producers only: number of strings inserted */
+    uint64_t *lat; /* Latency of each operation in nanoseconds, or NULL */
+    size_t nlat, lat_size;
+    double elapsed; /* Seconds */
+    pthread_t tid;
+    bool started;
+} stress_thread_t;
+
+/* Description and results of a stress test */
+typedef struct {
+    /* Set by the caller */
+    stress_queue_t queue;
+    int producers;
+    int consumers;
+    long ops;     /* Operations per producer */
+    int mix;      /* Percent of producer operations that are inserts */
+    bool latency; /* Record the latency of each operation */
+
+    /* Set by stress_run: producers first, then consumers */
+    stress_thread_t *threads;
+    double elapsed; /* Seconds taken by the threads */
+    long leftover;  /* Elements left in the queue by the threads */
+} stress_run_t;
+
+/*
+ * Run the stress test described by run, and fill in its results.
+ * Errors are reported at verbosity level 1.  Return true if every inserted
+ * string was removed exactly once, nothing else was removed and the queue
+ * freed all its memory.  If the test could not even be set up, threads is
+ * left NULL.  stress_done must be called afterwards either way.
+ */
+bool stress_run(stress_run_t *run);
+
+/* Free the results of a stress test */
+void stress_done(stress_run_t *run);
+
+#endif /* LAB0_STRESS_H */
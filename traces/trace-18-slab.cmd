@@ -0,0 +1,34 @@
+# Test of operations on queues carving their elements from slab chunks
+option fail 30
+option malloc 0
+option slab 4
+new
+ih dolphin
+ih bear
+ih gerbil
+it meerkat
+it bear
+it gerbil
+size
+rh gerbil
+rh bear
+rh dolphin
+ih squirrel
+ih koala
+ih aardvark
+it vulture
+reverse
+sort
+rh aardvark
+rh bear
+rh gerbil
+rh koala
+rh meerkat
+rh squirrel
+rh vulture
+size
+ih jaguar 20
+option malloc 25
+it gerbil 20
+option malloc 0
+free
@@ -0,0 +1,18 @@
+# Test of sorting large queues with several threads
+option fail 0
+option malloc 0
+new
+ih RAND 40000
+it dolphin 10000
+ih gerbil 10000
+option sortthreads 4
+sort
+size
+reverse
+sort
+rh
+option sortthreads 7
+sort
+size
+option sortthreads 1
+free
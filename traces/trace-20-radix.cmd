@@ -0,0 +1,34 @@
+# Test of sort with the radix sort engine
+option fail 0
+option malloc 0
+option sortalgo 1
+new
+ih gerbil
+ih Bear
+ih dolphin
+it bear
+it aardvark
+it Dolphin
+it meerkat
+ih dolphinfish
+sort
+rh aardvark
+rh Bear
+rh bear
+rh dolphin
+rh Dolphin
+rh dolphinfish
+rh gerbil
+rh meerkat
+ih RAND 20000
+it 00000000000000000000000000000000000000000000000000000000000000000001
+it 00000000000000000000000000000000000000000000000000000000000000000000 3
+reverse
+sort
+rh 00000000000000000000000000000000000000000000000000000000000000000000
+rh 00000000000000000000000000000000000000000000000000000000000000000000
+rh 00000000000000000000000000000000000000000000000000000000000000000000
+rh 00000000000000000000000000000000000000000000000000000000000000000001
+size
+option sortalgo 0
+free
@@ -0,0 +1,32 @@
+# Test of queues that share copies of equal long strings
+option fail 0
+option malloc 0
+option intern 1
+new
+it thequickbrownfoxjumpsoverthelazydogthequickbrownfox 3
+ih packmyboxwithfivedozenliquorjugspackmyboxwithfive
+it packmyboxwithfivedozenliquorjugspackmyboxwithfive
+ih thequickbrownfoxjumpsoverthelazydogthequickbrownfox
+ih RAND 50
+reverse
+rh packmyboxwithfivedozenliquorjugspackmyboxwithfive
+rh thequickbrownfoxjumpsoverthelazydogthequickbrownfox
+rh thequickbrownfoxjumpsoverthelazydogthequickbrownfox
+rh thequickbrownfoxjumpsoverthelazydogthequickbrownfox
+rh packmyboxwithfivedozenliquorjugspackmyboxwithfive
+rh thequickbrownfoxjumpsoverthelazydogthequickbrownfox
+sort
+it thequickbrownfoxjumpsoverthelazydogthequickbrownfox
+ih packmyboxwithfivedozenliquorjugspackmyboxwithfive
+size
+free
+new
+ih thequickbrownfoxjumpsoverthelazydogthequickbrownfox
+it thequickbrownfoxjumpsoverthelazydogthequickbrownfox
+option malloc 20
+option fail 30
+ih thequickbrownfoxjumpsoverthelazydogthequickbrownfox 10
+it packmyboxwithfivedozenliquorjugspackmyboxwithfive 10
+option malloc 0
+free
+option intern 0
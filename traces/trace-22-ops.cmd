@@ -0,0 +1,36 @@
+# Test of reverse mixed with insert and remove at both ends
+option fail 0
+option malloc 0
+new
+ih dolphin
+it bear
+ih gerbil
+reverse
+show
+rt gerbil
+it meerkat
+ih squirrel
+rh squirrel
+rt meerkat
+reverse
+it vulture
+ih lion
+show
+rt vulture
+reverse
+rh bear
+rt lion
+ih tiger 2
+it zebra
+reverse
+show
+rt tiger
+rh zebra
+rh dolphin
+rt tiger
+reverse
+ih koala
+reverse
+rt koala
+size
+free
@@ -0,0 +1,12 @@
+# Test of the concurrent stress command on both concurrent queues
+option fail 0
+option malloc 0
+stress 1 1 1000
+stress 2 2 2000
+option stressmix 50
+stress 3 1 1000
+option stressqueue 1
+stress 2 2 1000
+option stressmix 100
+stress 1 0 100
+option stressqueue 0
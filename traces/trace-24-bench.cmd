@@ -0,0 +1,12 @@
+# Test of timing queue operations with bench
+option fail 0
+option malloc 0
+new
+bench ih dolphin 100
+bench it RAND 50
+bench rh 50
+bench reverse 10
+bench size 10 5
+bench sort 3
+size
+free
@@ -0,0 +1,12 @@
+# Test of fitting the growth of queue operations with complexity
+option fail 0
+option malloc 0
+new
+ih dolphin 10
+complexity ih 16 512
+complexity rt 16 512
+complexity reverse 16 512
+complexity sort 16 256
+complexity free 16 256
+size
+free
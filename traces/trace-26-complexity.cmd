@@ -0,0 +1,3 @@
+# Test if q_remove_head and q_remove_tail are constant time complexity
+const rh
+const rt
@@ -0,0 +1,36 @@
+# Test of repeat blocks, nested and unterminated
+option fail 0
+option malloc 0
+new
+repeat 3 {
+ih dolphin
+repeat 2 {
+it bear
+}
+size
+}
+show
+size
+repeat 0 {
+rh
+}
+repeat 3 {
+rt bear
+repeat 1 {
+rh dolphin
+rt bear
+}
+}
+size
+repeat 1000 {
+ih gerbil
+it meerkat
+rh gerbil
+}
+rt meerkat
+size
+free
+new
+# The rest of the file is a block that never ends, so it never runs
+repeat 2 {
+rh
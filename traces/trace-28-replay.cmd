@@ -0,0 +1,29 @@
+# Test of recording queue operations and replaying them
+option fail 0
+option malloc 0
+record trace-28-replay.bin
+new
+ih RAND 5
+it dolphin 3
+ih bear
+rh bear
+rt dolphin
+reverse
+size 2
+sort
+it RAND
+rhq
+ih aardvark
+it zebra
+record
+free
+replay trace-28-replay.bin
+rh aardvark
+rt zebra
+size
+replay -d trace-28-replay.bin
+reverse
+rh zebra
+rt aardvark
+size
+free